@@ -13,7 +13,7 @@ using namespace std;
 void check_case(int run) {
 	int nbools;
 	assert(judge_in >> nbools);
-	cout << nbools << endl;
+	author_in << nbools << '\n';
 
 	vector<int> bools(nbools);
 	for (int pos = 0; pos < nbools; pos++) {
@@ -24,11 +24,11 @@ void check_case(int run) {
 	while (true) {
 		nquery++;
 		string operation;
-		if (!(author_out >> operation)) {
+		if (!author_out_reader.read_token(operation)) {
 			wrong_answer("testcase %d: Cannot parse operation in %dth query.\n", run, nquery);
 		}
 		int pos;
-		if (!(author_out >> pos)) {
+		if (!author_out_reader.read_int(pos)) {
 			wrong_answer("testcase %d: Cannot parse position in %dth query.\n", run, nquery);
 		}
 		if (pos < 0 || pos >= nbools) {
@@ -46,7 +46,7 @@ void check_case(int run) {
 		} else if (operation == "READ") {
 			// Simulate slow operation by sleeping for 0.1ms
 			usleep(100);
-			cout << (bools[pos] ? "true" : "false") << endl;
+			author_in << (bools[pos] ? "true" : "false") << '\n';
 		} else {
 			wrong_answer("testcase %d: Unknown instruction '%s'.\n", run, operation.c_str());
 		}
@@ -58,7 +58,7 @@ int main(int argc, char **argv) {
 
 	int nruns;
 	assert(judge_in >> nruns);
-	cout << nruns << endl;
+	author_in << nruns << '\n';
 
 	for (int run = 1; run <= nruns; run++) {
 		check_case(run);
@@ -66,7 +66,7 @@ int main(int argc, char **argv) {
 
 	// Check for trailing output.
 	string trash;
-	if (author_out >> trash) {
+	if (author_out_reader.read_token(trash)) {
 		wrong_answer("Trailing output: '%s'\n", trash.c_str());
 	}
 
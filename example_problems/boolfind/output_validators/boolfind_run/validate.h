@@ -16,6 +16,26 @@
  *        std::istream objects for judge input file, judge answer
  *        file, and submission output file.
  *
+ * - judge_in_reader, judge_ans_reader, author_out_reader:
+ *        faster buffered readers of the same files, with functions
+ *        read_token, read_int, read_long_long, read_double and eof.
+ *        Numbers must make up a complete token, in plain decimal
+ *        notation. Each reader is the buffer of the corresponding
+ *        istream above, so the two can be mixed. Do not read
+ *        std::cin directly, as that bypasses this buffer.
+ *
+ * - author_in, author_in_writer:
+ *        std::ostream and buffered writer for the input of the
+ *        submission in interactive problems. The buffer is flushed
+ *        when the validator waits for submission output and at exit,
+ *        so end lines with '\n' instead of std::endl. Do not write
+ *        to std::cout as well.
+ *
+ * - report_round_trips:
+ *        if set, the number of times the validator waited for the
+ *        submission after writing to it is added to the judge
+ *        message at accept or wrong answer.
+ *
  * - accept():
  *        exit and give Accepted!
  *
@@ -46,13 +66,24 @@
  */
 #pragma once
 
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
 #include <cstdarg>
 #include <cstdlib>
+#include <cstring>
+#include <charconv>
 #include <iostream>
-#include <fstream>
+#include <map>
 #include <sstream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
 
 typedef void (*feedback_function)(const std::string &, ...);
 
@@ -65,22 +96,239 @@ const std::string FILENAME_SCORE = "score.txt";
 
 #define USAGE "%s: judge_in judge_ans feedback_dir < author_out\n"
 
-std::ifstream judge_in, judge_ans;
-std::istream author_out(std::cin.rdbuf());
+/* Buffered writer to a file descriptor. It is also the buffer of an
+ * std::ostream writing to it.
+ */
+class token_writer : public std::streambuf {
+public:
+    // The number of flushes before waiting for a reply.
+    size_t round_trips = 0;
+
+    void open(int fd_) {
+        fd = fd_;
+        buffer.resize(1 << 16);
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    // Write formatted output, like printf.
+    [[gnu::format(printf, 2, 3)]] void print(const char *format, ...) {
+        va_list pvar;
+        va_start(pvar, format);
+        int len = vsnprintf(pptr(), epptr() - pptr(), format, pvar);
+        va_end(pvar);
+        if (len >= 0 && len < epptr() - pptr()) {
+            pbump(len);
+            return;
+        }
+        if (len < 0) return;
+        std::vector<char> str(len + 1);
+        va_start(pvar, format);
+        vsnprintf(str.data(), str.size(), format, pvar);
+        va_end(pvar);
+        sputn(str.data(), len);
+    }
+
+    // Write all buffered data. Returns false on errors.
+    bool flush() {
+        for (char *p = pbase(); p < pptr(); ) {
+            ssize_t nwritten = write(fd, p, pptr() - p);
+            if (nwritten < 0 && errno == EINTR) continue;
+            if (nwritten <= 0) {
+                setp(pbase(), epptr());
+                return false;
+            }
+            p += nwritten;
+        }
+        setp(pbase(), epptr());
+        return true;
+    }
+
+    // Flush before waiting for a reply to the buffered data.
+    void flush_for_reply() {
+        if (pptr() == pbase()) return;
+        round_trips++;
+        flush();
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (fd < 0 || !flush()) return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override { return flush() ? 0 : -1; }
+
+private:
+    int fd = -1;
+    std::vector<char> buffer;
+};
+
+/* Buffered reader of whitespace separated tokens from a file
+ * descriptor. A tied writer is flushed before it waits for input. It
+ * is also the buffer of an std::istream reading the same file.
+ */
+class token_reader : public std::streambuf {
+public:
+    void open(int fd_) {
+        fd = fd_;
+        buffer.resize(1 << 16);
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+
+    // Flush writer before waiting for input, like std::istream::tie.
+    void tie(token_writer *writer) { tied = writer; }
+
+    // Skip whitespace, and return whether nothing else is left.
+    bool eof() {
+        while (true) {
+            char *p = gptr();
+            while (p < egptr() && isspace(static_cast<unsigned char>(*p))) p++;
+            setg(eback(), p, egptr());
+            if (p < egptr()) return false;
+            if (!fill()) return true;
+        }
+    }
+
+    // Read the next token. It is valid until the next read.
+    bool read_token(std::string_view &token) {
+        if (eof()) return false;
+        size_t len = 0;
+        while (true) {
+            char *p = gptr() + len;
+            while (p < egptr() && !isspace(static_cast<unsigned char>(*p))) p++;
+            len = p - gptr();
+            if (p < egptr() || !fill()) break;
+        }
+        token = std::string_view(gptr(), len);
+        setg(eback(), gptr() + len, egptr());
+        return true;
+    }
+
+    bool read_token(std::string &token) {
+        std::string_view view;
+        if (!read_token(view)) return false;
+        token.assign(view);
+        return true;
+    }
+
+    // Read an integer: an optional minus sign and decimal digits.
+    bool read_int(int &value) { return read_integer(value); }
+    bool read_long_long(long long &value) { return read_integer(value); }
+
+    // Read a floating point number: an optional minus sign, decimal
+    // digits with an optional decimal point and an optional exponent.
+    bool read_double(double &value) {
+        std::string_view token;
+        if (!read_token(token) || !is_decimal(token)) return false;
+        char small[64];
+        std::string large;
+        const char *str = small;
+        if (token.size() < sizeof(small)) {
+            memcpy(small, token.data(), token.size());
+            small[token.size()] = 0;
+        } else {
+            large.assign(token);
+            str = large.c_str();
+        }
+        value = strtod(str, NULL);
+        return !std::isinf(value);
+    }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr() || fill()) return traits_type::to_int_type(*gptr());
+        return traits_type::eof();
+    }
+
+private:
+    int fd = -1;
+    std::vector<char> buffer;
+    token_writer *tied = NULL;
+
+    // Read more data after the unread data, which is moved to the start
+    // of the buffer. Returns false if there is no more.
+    bool fill() {
+        if (fd < 0) return false;
+        size_t keep = egptr() - gptr();
+        memmove(buffer.data(), gptr(), keep);
+        if (buffer.size() - keep < buffer.size() / 2) buffer.resize(2 * buffer.size());
+        if (tied) tied->flush_for_reply();
+        ssize_t nread;
+        do {
+            nread = read(fd, buffer.data() + keep, buffer.size() - keep);
+        } while (nread < 0 && errno == EINTR);
+        if (nread <= 0) {
+            setg(buffer.data(), buffer.data(), buffer.data() + keep);
+            return false;
+        }
+        setg(buffer.data(), buffer.data(), buffer.data() + keep + nread);
+        return true;
+    }
+
+    template <typename Int>
+    bool read_integer(Int &value) {
+        std::string_view token;
+        if (!read_token(token)) return false;
+        const char *end = token.data() + token.size();
+        std::from_chars_result res = std::from_chars(token.data(), end, value);
+        return res.ec == std::errc() && res.ptr == end;
+    }
+
+    static bool is_decimal(std::string_view s) {
+        size_t i = 0, digits = 0;
+        if (i < s.size() && s[i] == '-') i++;
+        for (; i < s.size() && isdigit(static_cast<unsigned char>(s[i])); i++) digits++;
+        if (i < s.size() && s[i] == '.') {
+            for (i++; i < s.size() && isdigit(static_cast<unsigned char>(s[i])); i++) digits++;
+        }
+        if (digits == 0) return false;
+        if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+            i++;
+            if (i < s.size() && (s[i] == '+' || s[i] == '-')) i++;
+            size_t exp_start = i;
+            while (i < s.size() && isdigit(static_cast<unsigned char>(s[i]))) i++;
+            if (i == exp_start) return false;
+        }
+        return i == s.size();
+    }
+};
+
+token_reader judge_in_reader, judge_ans_reader, author_out_reader;
+std::istream judge_in(&judge_in_reader), judge_ans(&judge_ans_reader);
+std::istream author_out(&author_out_reader);
+token_writer author_in_writer;
+std::ostream author_in(&author_in_writer);
+
+bool report_round_trips = false;
 
 char *feedbackdir = NULL;
 
+// The feedback files are opened when first written, and kept open.
+FILE *feedback_file(const std::string &category) {
+    static std::map<std::string, FILE *> files;
+    FILE *&f = files[category];
+    if (!f) {
+        std::ostringstream fname;
+        if (feedbackdir)
+            fname << feedbackdir << '/';
+        fname << category;
+        f = fopen(fname.str().c_str(), "a");
+        assert(f);
+    }
+    return f;
+}
+
 void vreport_feedback(const std::string &category,
                       const std::string &msg,
                       va_list pvar) {
-    std::ostringstream fname;
-    if (feedbackdir)
-        fname << feedbackdir << '/';
-    fname << category;
-    FILE *f = fopen(fname.str().c_str(), "a");
-    assert(f);
+    FILE *f = feedback_file(category);
     vfprintf(f, msg.c_str(), pvar);
-    fclose(f);
+    // Keep the messages in case the validator crashes later.
+    fflush(f);
 }
 
 void report_feedback(const std::string &category, const std::string &msg, ...) {
@@ -101,10 +349,19 @@ void judge_message(const std::string &msg, ...) {
     vreport_feedback(FILENAME_JUDGE_MESSAGE, msg, pvar);
 }
 
+// Send the remaining input to the submission, and report statistics.
+void end_interaction() {
+    author_in_writer.flush();
+    if (report_round_trips) {
+        judge_message("Interaction round trips: %zu\n", author_in_writer.round_trips);
+    }
+}
+
 void wrong_answer(const std::string &msg, ...) {
     va_list pvar;
     va_start(pvar, msg);
     vreport_feedback(FILENAME_JUDGE_MESSAGE, msg, pvar);
+    end_interaction();
     exit(EXITCODE_WA);
 }
 
@@ -116,11 +373,13 @@ void judge_error(const std::string &msg, ...) {
 }
 
 void accept() {
+    end_interaction();
     exit(EXITCODE_AC);
 }
 
 void accept_with_score(double scorevalue) {
     report_feedback(FILENAME_SCORE, "%.9le", scorevalue);
+    end_interaction();
     exit(EXITCODE_AC);
 }
 
@@ -143,15 +402,21 @@ void init_io(int argc, char **argv) {
     }
     feedbackdir = argv[3];
 
-    judge_in.open(argv[1], std::ios_base::in);
-    if (judge_in.fail()) {
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
         judge_error("%s: failed to open %s\n", argv[0], argv[1]);
     }
+    judge_in_reader.open(fd);
 
-    judge_ans.open(argv[2], std::ios_base::in);
-    if (judge_ans.fail()) {
+    fd = open(argv[2], O_RDONLY);
+    if (fd < 0) {
         judge_error("%s: failed to open %s\n", argv[0], argv[2]);
     }
+    judge_ans_reader.open(fd);
 
-    author_out.rdbuf(std::cin.rdbuf());
+    author_out_reader.open(STDIN_FILENO);
+    author_in_writer.open(STDOUT_FILENO);
+    author_out_reader.tie(&author_in_writer);
+    // Also send buffered input if the validator exits by itself.
+    atexit([] { author_in_writer.flush(); });
 }
@@ -0,0 +1,74 @@
+#!/bin/bash
+# Run the default compare script over the benchmark corpus and report its
+# throughput. Fails if a case gives the wrong result, or is slower than
+# the minimum throughput listed for it in the thresholds file.
+#
+# Usage: $0 <compare> <corpus dir> [<thresholds file>]
+
+cd "$(dirname "${BASH_SOURCE[0]}")" || exit 1
+
+COMPARE="$1"
+CORPUS="$2"
+THRESHOLDS="${3:-thresholds}"
+# Number of runs per case, of which the fastest is taken.
+RUNS=${RUNS:-3}
+
+FEEDBACK=$(mktemp -d)
+trap 'rm -rf "$FEEDBACK"' EXIT
+
+fail=0
+
+# Minimum throughput in MB/s for a case, or 0 if none is listed.
+threshold() {
+	awk -v name="$1" '$1 == name { print $2; found=1 } END { if (!found) print 0 }' "$THRESHOLDS"
+}
+
+# Usage: run_case <name> <expected exitcode> [<compare args>...]
+run_case() {
+	name="$1"; shift
+	expected="$1"; shift
+
+	best=
+	for _ in $(seq "$RUNS"); do
+		start=$(date +%s%N)
+		"$COMPARE" /dev/null "$CORPUS/$name.ans" "$FEEDBACK" "$@" < "$CORPUS/$name.out"
+		exitcode=$?
+		end=$(date +%s%N)
+		if [ "$exitcode" -ne "$expected" ]; then
+			echo -e "\e[31mFAIL $name: expected exitcode $expected, got $exitcode\e[0m" >&2
+			fail=1
+			return
+		fi
+		ns=$((end - start))
+		if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+			best=$ns
+		fi
+	done
+
+	bytes=$(( $(stat -c %s "$CORPUS/$name.ans") + $(stat -c %s "$CORPUS/$name.out") ))
+	tokens=$(cat "$CORPUS/$name.tokens")
+	min=$(threshold "$name")
+	result=$(awk -v bytes="$bytes" -v tokens="$tokens" -v ns="$best" -v min="$min" 'BEGIN {
+		mbps = bytes / 1048576 / (ns / 1e9)
+		printf "%-14s %10.1f MB/s %10.2f Mtokens/s %8.3f s (min %s MB/s)\n", "'"$name"'", mbps, tokens / 1e6 / (ns / 1e9), ns / 1e9, min
+		exit (mbps < min)
+	}')
+	status=$?
+	echo "$result"
+	if [ $status -ne 0 ]; then
+		echo -e "\e[31mFAIL $name: throughput below threshold\e[0m" >&2
+		fail=1
+	fi
+}
+
+run_case identical     42
+run_case late_mismatch 43
+run_case integers      42
+run_case floats        42 float_tolerance 1e-6
+run_case long_lines    42
+run_case short_lines   42
+run_case whitespace    42
+run_case case          42
+run_case padded_lines  42 space_change_sensitive
+
+exit $fail
@@ -0,0 +1,148 @@
+// Generate the benchmark corpus for the default compare script: pairs of
+// judge answer and team output of about the given size, which compare
+// equal (or differ late, for late_mismatch). Writes <case>.ans,
+// <case>.out and <case>.tokens, the number of tokens in the answer, to
+// the output directory.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+std::mt19937_64 rng(20240531);
+std::string dir;
+size_t target;
+
+struct output {
+	FILE *f;
+	size_t size = 0;
+
+	output(const std::string &name) {
+		f = fopen(name.c_str(), "w");
+		if (f == nullptr) {
+			perror(name.c_str());
+			exit(1);
+		}
+	}
+	~output() { fclose(f); }
+
+	void put(const std::string &s) {
+		fwrite(s.data(), 1, s.size(), f);
+		size += s.size();
+	}
+};
+
+void write_tokens(const char *name, size_t tokens) {
+	output t(dir + "/" + name + ".tokens");
+	t.put(std::to_string(tokens) + "\n");
+}
+
+std::string word(size_t maxlen) {
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	std::string w(1 + rng() % maxlen, ' ');
+	for (char &c : w) c = letters[rng() % (sizeof(letters) - 1)];
+	return w;
+}
+
+std::string swapcase(std::string w) {
+	for (char &c : w) {
+		if (c >= 'a' && c <= 'z') c += 'A' - 'a';
+		else if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+	}
+	return w;
+}
+
+std::string spaces(size_t maxlen) {
+	static const char ws[] = " \t\n\r\v\f";
+	std::string s(1 + rng() % maxlen, ' ');
+	for (char &c : s) c = ws[rng() % (sizeof(ws) - 1)];
+	return s;
+}
+
+// Write a case from a generator of (answer token, team token) pairs and
+// their separators.
+template <typename Gen>
+void gen_case(const char *name, Gen gen) {
+	output ans(dir + "/" + name + ".ans"), out(dir + "/" + name + ".out");
+	size_t tokens = 0;
+	while (ans.size < target) {
+		std::string a, aspace, b, bspace;
+		gen(a, aspace, b, bspace);
+		ans.put(a);
+		ans.put(aspace);
+		out.put(b);
+		out.put(bspace);
+		tokens++;
+	}
+	write_tokens(name, tokens);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <outdir> <size in MB>\n", argv[0]);
+		return 1;
+	}
+	dir = argv[1];
+	target = strtoul(argv[2], nullptr, 10) << 20;
+
+	gen_case("integers", [](std::string &a, std::string &as, std::string &b, std::string &bs) {
+		a = b = std::to_string(rng() % 2000000000);
+		as = "\n";
+		bs = " ";
+	});
+	gen_case("floats", [](std::string &a, std::string &as, std::string &b, std::string &bs) {
+		char buf[64];
+		double x = std::uniform_real_distribution<double>(-1e6, 1e6)(rng);
+		snprintf(buf, sizeof(buf), "%.9f", x);
+		a = buf;
+		snprintf(buf, sizeof(buf), "%.8f", x);
+		b = buf;
+		as = bs = "\n";
+	});
+	size_t col = 0;
+	gen_case("long_lines", [&](std::string &a, std::string &as, std::string &b, std::string &bs) {
+		a = b = word(12);
+		as = ++col % 10000 == 0 ? "\n" : " ";
+		bs = col % 10000 == 0 ? "\n" : "\t";
+	});
+	gen_case("short_lines", [](std::string &a, std::string &as, std::string &b, std::string &bs) {
+		a = b = word(1);
+		as = "\n";
+		bs = "\r\n";
+	});
+	gen_case("whitespace", [](std::string &a, std::string &as, std::string &b, std::string &bs) {
+		a = b = word(4);
+		as = spaces(20);
+		bs = spaces(20);
+	});
+	gen_case("case", [](std::string &a, std::string &as, std::string &b, std::string &bs) {
+		a = word(10);
+		b = swapcase(a);
+		as = bs = "\n";
+	});
+	gen_case("padded_lines", [](std::string &a, std::string &as, std::string &b, std::string &bs) {
+		a = word(10);
+		b = swapcase(a);
+		as = bs = std::string(rng() % 40, ' ') + "\n";
+	});
+
+	// Identical output, and the same with a single change near the end.
+	std::string ans;
+	size_t tokens = 0;
+	while (ans.size() < target) {
+		ans += std::to_string(rng() % 2000000000) + "\n";
+		tokens++;
+	}
+	std::string out = ans;
+	size_t pos = out.size() * 99 / 100;
+	while (out[pos] == '\n') pos++;
+	out[pos] = out[pos] == '7' ? '8' : '7';
+	for (const char *name : {"identical", "late_mismatch"}) {
+		output(dir + "/" + name + ".ans").put(ans);
+		output(dir + "/" + name + ".out").put(name == std::string("identical") ? ans : out);
+		write_tokens(name, tokens);
+	}
+
+	return 0;
+}
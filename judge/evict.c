@@ -1,9 +1,15 @@
+/* For the DT_* file types of struct dirent. */
+#define _DEFAULT_SOURCE
+
 #include "config.h"
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <getopt.h>
+#include <limits.h>
 #include <malloc.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -14,103 +20,322 @@
 #define PROGRAM "evict"
 #define VERSION DOMJUDGE_VERSION "/" REVISION
 
+/* Default and maximum number of threads to walk the tree with. */
+#define DEFAULT_THREADS 4
+#define MAX_THREADS 64
+
+/* Maximum number of include/exclude rules. */
+#define MAX_RULES 64
+
 extern int errno;
 const char *progname;
 
 int be_verbose;
 int show_help;
 int show_version;
+int nthreads;
+int no_dereference;
+int use_since;
+struct timespec since;
+
+/* Include and exclude rules: the first rule with a matching pattern
+   decides whether an entry is evicted. Patterns containing a `/' are
+   matched against the path relative to the directory to evict, others
+   against the name of the entry. */
+struct rule {
+	const char *pattern;
+	int include;
+	int match_path;
+} rules[MAX_RULES];
+int nrules;
+int match_paths;
+size_t rootlen;
 
 struct option const long_opts[] = {
+	{"jobs",    required_argument, NULL,         'j'},
+	{"include", required_argument, NULL,         'i'},
+	{"exclude", required_argument, NULL,         'x'},
+	{"since",   required_argument, NULL,         's'},
+	{"no-dereference", no_argument, NULL,        'P'},
 	{"verbose", no_argument,       NULL,         'v'},
 	{"help",    no_argument,       &show_help,    1 },
 	{"version", no_argument,       &show_version, 1 },
 	{ NULL,     0,                 NULL,          0 }
 };
 
+/* A directory still to be evicted: its open file descriptor and path,
+   the latter only used for messages. */
+struct dir_job {
+	int fd;
+	char *path;
+	struct dir_job *next;
+};
+
+/* Directories waiting for a thread. Only directories that can be handed
+   to an idle thread are queued, the others are walked depth-first by the
+   thread that finds them, which bounds the number of open directories. */
+struct dir_job *queue;
+int nqueued;
+int nidle;
+int nbusy;
+pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
 void usage()
 {
 	printf("\
 Usage: %s [OPTION]... DIRECTORY\n\
 Evicts all files in a directory tree from the kernel filesystem cache.\n\
 \n\
+  -j, --jobs=N         walk the directory tree with N threads (default %d)\n\
+  -i, --include=PATTERN  evict entries matching PATTERN\n\
+  -x, --exclude=PATTERN  do not evict entries matching PATTERN\n\
+  -s, --since=TIME     only evict files modified at or after TIME, in\n\
+                         seconds since the epoch\n\
+  -P, --no-dereference do not follow symbolic links\n\
   -v, --verbose        display some extra warnings and information\n\
       --help           display this help and exit\n\
       --version        output version information and exit\n\
-\n", progname);
+\n\
+The first include or exclude rule that matches an entry decides whether\n\
+it is evicted; entries that match no rule are. PATTERN is a shell\n\
+wildcard pattern matched against the entry name, or against its path\n\
+relative to DIRECTORY if it contains a `/'. Excluded directories are\n\
+skipped entirely.\n\
+\n", progname, DEFAULT_THREADS);
 	exit(0);
 }
 
-void evict_directory(char *dirname) {
+void evict_directory(int dirfd, char *dirname);
+
+/* Check the rules for an entry of a directory. */
+int is_included(const char *dirname, const char *name)
+{
+	char path[PATH_MAX];
+
+	if ( match_paths ) {
+		const char *reldir = dirname + rootlen;
+		if ( *reldir=='/' ) reldir++;
+		snprintf(path, sizeof(path), "%s%s%s", reldir, *reldir ? "/" : "", name);
+	}
+	for(int i=0; i<nrules; i++) {
+		if ( rules[i].match_path ) {
+			if ( fnmatch(rules[i].pattern, path, FNM_PATHNAME)==0 ) return rules[i].include;
+		} else {
+			if ( fnmatch(rules[i].pattern, name, 0)==0 ) return rules[i].include;
+		}
+	}
+	return 1;
+}
+
+/* Whether a file was modified before the `since' time. */
+int is_older(const struct stat *s)
+{
+	return s->st_mtim.tv_sec < since.tv_sec ||
+	       (s->st_mtim.tv_sec==since.tv_sec && s->st_mtim.tv_nsec < since.tv_nsec);
+}
+
+/* Evict the file open at fd. */
+void evict_file(int fd, const char *dirname, const char *name)
+{
+	int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	if ( ret!=0 ) {
+		warning(ret, "Unable to evict file: %s/%s", dirname, name);
+	} else {
+		if (be_verbose) logmsg(LOG_DEBUG, "Evicted file: %s/%s", dirname, name);
+	}
+}
+
+/* Evict a subdirectory: hand it to an idle thread if there is one,
+   otherwise walk it now. */
+void evict_subdirectory(int fd, const char *dirname, const char *name)
+{
+	char *path = allocstr("%s/%s", dirname, name);
+
+	pthread_mutex_lock(&queue_lock);
+	if ( nqueued<nidle ) {
+		struct dir_job *job = (struct dir_job *) malloc(sizeof(struct dir_job));
+		if ( job==NULL ) abort();
+		job->fd = fd;
+		job->path = path;
+		job->next = queue;
+		queue = job;
+		nqueued++;
+		pthread_cond_signal(&queue_cond);
+		pthread_mutex_unlock(&queue_lock);
+		return;
+	}
+	pthread_mutex_unlock(&queue_lock);
+
+	evict_directory(fd, path);
+}
+
+/* Evict the files in the directory open at dirfd, which is closed. */
+void evict_directory(int dirfd, char *dirname)
+{
 	DIR *dir;
 	struct dirent *entry;
-	int fd;
-	char *entry_path;
 	struct stat s;
+	int fd;
+	unsigned char type;
 
-	dir = opendir(dirname);
-	if (dir != NULL) {
-		if (be_verbose) logmsg(LOG_INFO, "Evicting all files in directory: %s", dirname);
+	dir = fdopendir(dirfd);
+	if ( dir==NULL ) {
+		warning(errno, "Unable to open directory: %s", dirname);
+		close(dirfd);
+		free(dirname);
+		return;
+	}
+	if (be_verbose) logmsg(LOG_INFO, "Evicting all files in directory: %s", dirname);
 
-		/* Read everything in the directory */
-		while ( (entry = readdir(dir)) != NULL ) {
-			/* skip over current/parent directory entries */
-			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-				continue;
-			}
+	/* Read everything in the directory */
+	while ( (entry = readdir(dir)) != NULL ) {
+		/* skip over current/parent directory entries */
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
 
-			/* Construct the full file path */
-			entry_path = allocstr("%s/%s", dirname, entry->d_name);
-			fd = open(entry_path, O_RDONLY, 0);
-			if (fd == -1) {
-				warning(errno, "Unable to open file: %s", entry_path);
-				goto entry_done;
-			}
+		if ( nrules>0 && !is_included(dirname, entry->d_name) ) {
+			if (be_verbose) logmsg(LOG_DEBUG, "Skipping excluded: %s/%s", dirname, entry->d_name);
+			continue;
+		}
 
-			if (fstat(fd, &s) < 0) {
-				if (be_verbose) logerror(errno, "Unable to stat file/directory: %s\n", entry_path);
-				goto entry_done;
+		/* Only files and directories have pages to evict. The type of
+		   symlinks and unknown types is determined with a stat, as is
+		   the age of files if it matters. */
+		type = entry->d_type;
+		if ( type==DT_LNK && no_dereference ) continue;
+		if ( type==DT_UNKNOWN || type==DT_LNK || (type==DT_REG && use_since) ) {
+			if ( fstatat(dirfd, entry->d_name, &s, no_dereference ? AT_SYMLINK_NOFOLLOW : 0)<0 ) {
+				if (be_verbose) logerror(errno, "Unable to stat file/directory: %s/%s",
+				                         dirname, entry->d_name);
+				continue;
 			}
-			if (S_ISDIR(s.st_mode)) {
-				/* Recurse into subdirectories */
-				evict_directory(entry_path);
-			} else {
-				/* evict this file from the cache */
-				if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED)) {
-					warning(errno, "Unable to evict file: %s\n", entry_path);
-				} else {
-					if (be_verbose) logmsg(LOG_DEBUG, "Evicted file: %s", entry_path);
+			if ( S_ISDIR(s.st_mode) ) {
+				type = DT_DIR;
+			} else if ( S_ISREG(s.st_mode) ) {
+				type = DT_REG;
+				if ( use_since && is_older(&s) ) {
+					if (be_verbose) logmsg(LOG_DEBUG, "Keeping older file: %s/%s",
+					                       dirname, entry->d_name);
+					continue;
 				}
+			} else {
+				continue;
 			}
-		  entry_done:
+		}
+		if ( type!=DT_REG && type!=DT_DIR ) continue;
 
-			if ( fd!=-1 && close(fd)!=0 ) {
-				warning(errno, "Unable to close file: %s", entry_path);
-			}
-			free(entry_path);
+		fd = openat(dirfd, entry->d_name, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK |
+		            (no_dereference ? O_NOFOLLOW : 0));
+		if ( fd==-1 ) {
+			warning(errno, "Unable to open file: %s/%s", dirname, entry->d_name);
+			continue;
 		}
-		if ( closedir(dir)!=0 ) {
-			warning(errno, "Unable to close directory: %s", dirname);
+
+		if ( type==DT_DIR ) {
+			evict_subdirectory(fd, dirname, entry->d_name);
+			continue;
 		}
-	} else {
-		warning(errno, "Unable to open directory: %s", dirname);
+		evict_file(fd, dirname, entry->d_name);
+
+		if ( close(fd)!=0 ) {
+			warning(errno, "Unable to close file: %s/%s", dirname, entry->d_name);
+		}
+	}
+	if ( closedir(dir)!=0 ) {
+		warning(errno, "Unable to close directory: %s", dirname);
+	}
+	free(dirname);
+}
+
+/* Thread that evicts queued directories until all work is done. */
+void *evict_thread(void *arg)
+{
+	struct dir_job *job;
+
+	(void) arg;
+	pthread_mutex_lock(&queue_lock);
+	while ( 1 ) {
+		if ( queue==NULL ) {
+			nbusy--;
+			if ( nbusy==0 ) {
+				/* Nothing queued and nobody left to queue more. */
+				pthread_cond_broadcast(&queue_cond);
+				break;
+			}
+			nidle++;
+			while ( queue==NULL && nbusy>0 ) pthread_cond_wait(&queue_cond, &queue_lock);
+			nidle--;
+			if ( queue==NULL ) break;
+			nbusy++;
+		}
+		job = queue;
+		queue = job->next;
+		nqueued--;
+		pthread_mutex_unlock(&queue_lock);
+
+		evict_directory(job->fd, job->path);
+		free(job);
+
+		pthread_mutex_lock(&queue_lock);
 	}
+	pthread_mutex_unlock(&queue_lock);
+	return NULL;
 }
 
 int main(int argc, char *argv[])
 {
 	int opt;
 	char* dirname;
+	char *ptr;
+	int fd;
+	double since_secs;
+	pthread_t threads[MAX_THREADS];
 
 	progname = argv[0];
 
 	/* Parse command-line options */
 	be_verbose = show_help = show_version = 0;
+	nthreads = DEFAULT_THREADS;
+	no_dereference = use_since = nrules = match_paths = 0;
 	opterr = 0;
-	while ( (opt = getopt_long(argc,argv,"+v",long_opts,(int *) 0))!=-1 ) {
+	while ( (opt = getopt_long(argc,argv,"+j:i:x:s:Pv",long_opts,(int *) 0))!=-1 ) {
 		switch ( opt ) {
 		case 0:   /* long-only option */
 			break;
+		case 'j': /* jobs option */
+			nthreads = strtol(optarg, &ptr, 10);
+			if ( *ptr!=0 || nthreads<1 || nthreads>MAX_THREADS ) {
+				logmsg(LOG_ERR, "invalid number of jobs specified: `%s'", optarg);
+				return 0;
+			}
+			break;
+		case 'i': /* include option */
+		case 'x': /* exclude option */
+			if ( nrules>=MAX_RULES ) {
+				logmsg(LOG_ERR, "too many include/exclude rules");
+				return 0;
+			}
+			rules[nrules].pattern = optarg;
+			rules[nrules].include = (opt=='i');
+			rules[nrules].match_path = (strchr(optarg, '/')!=NULL);
+			if ( rules[nrules].match_path ) match_paths = 1;
+			nrules++;
+			break;
+		case 's': /* since option */
+			since_secs = strtod(optarg, &ptr);
+			if ( *ptr!=0 || ptr==optarg || since_secs<0 ) {
+				logmsg(LOG_ERR, "invalid time specified: `%s'", optarg);
+				return 0;
+			}
+			use_since = 1;
+			since.tv_sec = (time_t) since_secs;
+			since.tv_nsec = (long) ((since_secs - since.tv_sec) * 1e9);
+			break;
+		case 'P': /* no-dereference option */
+			no_dereference = 1;
+			break;
 		case 'v': /* verbose option */
 			be_verbose = 1;
 			verbose = LOG_DEBUG;
@@ -134,8 +359,33 @@ int main(int argc, char *argv[])
 
 	/* directory to evict */
 	dirname = argv[optind];
+	rootlen = strlen(dirname);
 
-	evict_directory(dirname);
+	fd = open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if ( fd==-1 ) {
+		warning(errno, "Unable to open directory: %s", dirname);
+		return 0;
+	}
+	queue = (struct dir_job *) malloc(sizeof(struct dir_job));
+	if ( queue==NULL ) abort();
+	queue->fd = fd;
+	queue->path = strdup(dirname);
+	queue->next = NULL;
+	nqueued = 1;
+
+	/* The main thread is one of the workers. */
+	nbusy = nthreads;
+	for(int i=1; i<nthreads; i++) {
+		if ( pthread_create(&threads[i], NULL, evict_thread, NULL)!=0 ) {
+			pthread_mutex_lock(&queue_lock);
+			nbusy -= nthreads - i;
+			pthread_mutex_unlock(&queue_lock);
+			nthreads = i;
+			break;
+		}
+	}
+	evict_thread(NULL);
+	for(int i=1; i<nthreads; i++) pthread_join(threads[i], NULL);
 
 	return 0;
 }
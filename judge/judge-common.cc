@@ -0,0 +1,385 @@
+/*
+  judge-common.cc -- shared code of the judgehost programs that run
+  the compile, run and compare steps of a judging.
+
+  Part of the DOMjudge Programming Contest Jury System and licensed
+  under the GNU GPL. See README and COPYING for details.
+*/
+
+#include "config.h"
+
+#include "judge-common.h"
+
+#include "lib.error.h"
+#include "lib.misc.h"
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <cmath>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+volatile sig_atomic_t terminated = 0;
+
+// The command that run() is waiting for.
+static volatile pid_t running_pid = -1;
+
+static void pass_on_sigterm(int) {
+  terminated = 1;
+  if (running_pid > 0) {
+    kill(running_pid, SIGTERM);
+  }
+}
+
+void catch_sigterm() {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = pass_on_sigterm;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGTERM, &sa, nullptr) != 0) {
+    fail(errno, "cannot install signal handler");
+  }
+}
+
+string env(const char *name) {
+  const char *value = getenv(name);
+  return value == nullptr ? "" : value;
+}
+
+int exitcode_for(const char *name) {
+  string value = env(name);
+  return value.empty() ? 1 : atoi(value.c_str());
+}
+
+bool init_logging(const string &cpuset) {
+  char hostname[256];
+  if (gethostname(hostname, sizeof(hostname)) != 0) {
+    strcpy(hostname, "localhost");
+  }
+  hostname[sizeof(hostname) - 1] = 0;
+  *strchrnul(hostname, '.') = 0;
+  string logfile = env("DJ_LOGDIR") + "/judge." + hostname +
+                   (cpuset.empty() ? "" : "-" + cpuset) + ".log";
+  stdlog = fopen(logfile.c_str(), "a");
+  loglevel = LOG_DEBUG;
+
+  // Check for judge backend debugging:
+  bool debug = !env("DEBUG").empty();
+  if (debug) {
+    verbose = LOG_DEBUG;
+    logmsg(LOG_NOTICE, "debugging enabled, DEBUG='%s'", env("DEBUG").c_str());
+  } else {
+    verbose = LOG_ERR;
+  }
+  setenv("VERBOSE", to_string(verbose).c_str(), 1);
+  return debug;
+}
+
+void fatal(const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  char *msg = vallocstr(format, ap);
+  va_end(ap);
+  logmsg(LOG_ERR, "error: %s", msg);
+  exit(E_INTERNAL);
+}
+
+void fail(int errnum, const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  char *msg = vallocstr(format, ap);
+  va_end(ap);
+  if (errnum != 0) {
+    logmsg(LOG_ERR, "error: %s: %s", msg, strerror(errnum));
+  } else {
+    logmsg(LOG_ERR, "error: %s", msg);
+  }
+  cleanexit(E_INTERNAL);
+}
+
+bool is_regular(const string &path) {
+  struct stat s;
+  return stat(path.c_str(), &s) == 0 && S_ISREG(s.st_mode);
+}
+
+bool is_executable(const string &path) {
+  struct stat s;
+  return access(path.c_str(), X_OK) == 0 && stat(path.c_str(), &s) == 0 &&
+         !S_ISDIR(s.st_mode);
+}
+
+off_t file_size(const string &path) {
+  struct stat s;
+  if (stat(path.c_str(), &s) != 0) {
+    return -1;
+  }
+  return s.st_size;
+}
+
+int open_or_fail(const string &path, int flags, mode_t mode) {
+  int fd = open(path.c_str(), flags | O_CLOEXEC | O_NOCTTY, mode);
+  if (fd < 0) {
+    fail(errno, "cannot open `%s'", path.c_str());
+  }
+  return fd;
+}
+
+void touch(const string &path) {
+  int fd = open_or_fail(path, O_WRONLY | O_CREAT);
+  if (futimens(fd, nullptr) != 0) {
+    fail(errno, "cannot touch `%s'", path.c_str());
+  }
+  close(fd);
+}
+
+void chmod_add(const string &path, mode_t add) {
+  struct stat s;
+  if (stat(path.c_str(), &s) != 0 ||
+      chmod(path.c_str(), (s.st_mode | add) & 07777) != 0) {
+    fail(errno, "cannot change mode of `%s'", path.c_str());
+  }
+}
+
+void chmod_remove(const string &path, mode_t remove) {
+  struct stat s;
+  if (stat(path.c_str(), &s) != 0 ||
+      chmod(path.c_str(), s.st_mode & ~remove & 07777) != 0) {
+    fail(errno, "cannot change mode of `%s'", path.c_str());
+  }
+}
+
+void make_dir(const string &path, mode_t mode, bool may_exist) {
+  if (mkdir(path.c_str(), mode) != 0) {
+    if (errno == EEXIST && may_exist) {
+      return;
+    }
+    fail(errno, "cannot create directory `%s'", path.c_str());
+  }
+  if (chmod(path.c_str(), mode) != 0) {
+    fail(errno, "cannot change mode of `%s'", path.c_str());
+  }
+}
+
+void write_all(int fd, const char *data, size_t len, const string &path) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fail(errno, "cannot write to `%s'", path.c_str());
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+bool copy_file(const string &from, const string &to, bool fatal_errors) {
+  int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat s;
+  if (in < 0 || fstat(in, &s) != 0) {
+    if (!fatal_errors) {
+      if (in >= 0) close(in);
+      return false;
+    }
+    fail(errno, "cannot open `%s'", from.c_str());
+  }
+  unlink(to.c_str());
+  int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, s.st_mode & 0777);
+  if (out < 0) {
+    close(in);
+    if (!fatal_errors) return false;
+    fail(errno, "cannot create `%s'", to.c_str());
+  }
+
+  ssize_t n;
+  while ((n = copy_file_range(in, nullptr, out, nullptr, SIZE_MAX >> 1, 0)) > 0) {}
+  if (n < 0) {
+    // Not supported between these filesystems: copy through a buffer.
+    static char buf[65536];
+    if (lseek(in, 0, SEEK_SET) != 0 || ftruncate(out, 0) != 0) {
+      n = -1;
+    } else {
+      while ((n = read(in, buf, sizeof(buf))) > 0) {
+        write_all(out, buf, n, to);
+      }
+    }
+  }
+  close(in);
+  if (close(out) != 0) n = -1;
+  if (n < 0) {
+    if (!fatal_errors) return false;
+    fail(errno, "cannot copy `%s' to `%s'", from.c_str(), to.c_str());
+  }
+  return true;
+}
+
+string read_file(const string &path) {
+  string data;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return data;
+  }
+  char buf[65536];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    data.append(buf, n);
+  }
+  close(fd);
+  return data;
+}
+
+string read_message(const string &path) {
+  string data = read_file(path);
+  while (!data.empty() && data.back() == '\n') data.pop_back();
+  return data;
+}
+
+void append_file(const string &path, const string &data) {
+  int fd = open_or_fail(path, O_WRONLY | O_CREAT | O_APPEND);
+  write_all(fd, data.data(), data.size(), path);
+  close(fd);
+}
+
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *) {
+  return remove(path) != 0 && errno != ENOENT ? -1 : 0;
+}
+
+void remove_tree(const string &path) {
+  if (nftw(path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0 && errno != ENOENT) {
+    fail(errno, "cannot remove `%s'", path.c_str());
+  }
+}
+
+static mode_t tree_mode_mask;
+
+static int chmod_entry(const char *path, const struct stat *s, int type, struct FTW *) {
+  if (type == FTW_SL) {
+    return 0;
+  }
+  return chmod(path, s->st_mode & ~tree_mode_mask & 07777);
+}
+
+void chmod_tree(const string &path, mode_t remove) {
+  tree_mode_mask = remove;
+  if (nftw(path.c_str(), chmod_entry, 16, FTW_PHYS) != 0) {
+    fail(errno, "cannot change mode of `%s'", path.c_str());
+  }
+}
+
+map<string, string> read_meta(const string &path) {
+  map<string, string> meta;
+  string data = read_file(path);
+  size_t pos = 0;
+  while (pos < data.size()) {
+    size_t eol = data.find('\n', pos);
+    if (eol == string::npos) eol = data.size();
+    size_t sep = data.find(": ", pos);
+    if (sep != string::npos && sep < eol) {
+      meta.emplace(data.substr(pos, sep - pos), data.substr(sep + 2, eol - sep - 2));
+    }
+    pos = eol + 1;
+  }
+  return meta;
+}
+
+
+string dir_of(const string &path) {
+  vector<char> buf(path.begin(), path.end());
+  buf.push_back('\0');
+  return dirname(buf.data());
+}
+
+string base_of(const string &path) {
+  vector<char> buf(path.begin(), path.end());
+  buf.push_back('\0');
+  return basename(buf.data());
+}
+
+pid_t spawn(const vector<string> &cmd, int in, int out, int err, bool err2out,
+            const limits_t *limits) {
+  vector<const char *> args;
+  for (size_t i = 1; i < cmd.size(); i++) {
+    args.push_back(cmd[i].c_str());
+  }
+  // Always redirect, so that execute() does not wait for the command.
+  int stdio[3] = {in < 0 ? STDIN_FILENO : in, out < 0 ? STDOUT_FILENO : out,
+                  err < 0 ? STDERR_FILENO : err};
+  string cmdline = cmd[0];
+  for (const auto &arg : args) {
+    cmdline += string(" ") + arg;
+  }
+  logmsg(LOG_DEBUG, "runcheck: %s", cmdline.c_str());
+
+  // The command inherits our CPU affinity when it is started, so that
+  // it already sees it when it decides how many threads to use.
+  cpu_set_t old_cpus;
+  bool pinned = limits != nullptr && limits->cpus != nullptr &&
+                sched_getaffinity(0, sizeof(old_cpus), &old_cpus) == 0;
+  if (pinned && sched_setaffinity(0, sizeof(*limits->cpus), limits->cpus) != 0) {
+    fail(errno, "cannot set CPU affinity for `%s'", cmd[0].c_str());
+  }
+  pid_t pid = execute(cmd[0].c_str(), args.data(), args.size(), stdio, err2out);
+  int saved_errno = errno;
+  if (pinned && sched_setaffinity(0, sizeof(old_cpus), &old_cpus) != 0) {
+    fail(errno, "cannot restore CPU affinity");
+  }
+  if (pid < 0) {
+    fail(saved_errno, "cannot start `%s'", cmd[0].c_str());
+  }
+
+  if (limits != nullptr && limits->cputime > 0) {
+    struct rlimit lim;
+    lim.rlim_cur = (rlim_t)ceil(limits->cputime);
+    lim.rlim_max = lim.rlim_cur + 1;
+    if (prlimit(pid, RLIMIT_CPU, &lim, nullptr) != 0) {
+      kill(pid, SIGKILL);
+      fail(errno, "cannot set CPU time limit of `%s'", cmd[0].c_str());
+    }
+  }
+  if (limits != nullptr && limits->memsize > 0) {
+    struct rlimit lim;
+    lim.rlim_cur = lim.rlim_max = (rlim_t)limits->memsize * 1024;
+    if (prlimit(pid, RLIMIT_AS, &lim, nullptr) != 0) {
+      kill(pid, SIGKILL);
+      fail(errno, "cannot set memory limit of `%s'", cmd[0].c_str());
+    }
+  }
+  return pid;
+}
+
+int wait_for(pid_t pid) {
+  int status;
+  // Do not hold back buffered messages while we may block for long.
+  logflush();
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      fail(errno, "cannot wait for process %d", (int)pid);
+    }
+  }
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return WEXITSTATUS(status);
+}
+
+int run(const vector<string> &cmd, int in, int out, int err, bool err2out,
+        const limits_t *limits) {
+  running_pid = spawn(cmd, in, out, err, err2out, limits);
+  if (terminated) {
+    kill(running_pid, SIGTERM);
+  }
+  int exitcode = wait_for(running_pid);
+  running_pid = -1;
+  return exitcode;
+}
@@ -0,0 +1,125 @@
+/*
+  judge-common.h -- shared code of the judgehost programs that run
+  the compile, run and compare steps of a judging.
+
+  Part of the DOMjudge Programming Contest Jury System and licensed
+  under the GNU GPL. See README and COPYING for details.
+
+  These replace the shell scripts that did this work, and keep their
+  conventions: errors are logged and exit with status E_INTERNAL, and
+  commands are started like the shell would, returning its exitcode.
+*/
+
+#ifndef JUDGE_COMMON_H
+#define JUDGE_COMMON_H
+
+#include <csignal>
+#include <map>
+#include <sched.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// Exitcode on internal errors, as used by the judging shell scripts.
+const int E_INTERNAL = 127;
+
+// Clean up and exit with status; defined by each program and called
+// on unexpected errors.
+[[noreturn]] void cleanexit(int status);
+
+std::string env(const char *name);
+// Value of an environment variable, or empty if it is not set.
+
+int exitcode_for(const char *name);
+// The exitcode for a verdict, as passed by the judgedaemon in the
+// environment variable name, defaulting to 1.
+
+bool init_logging(const std::string &cpuset);
+// Log to the judge log file of this host and judgedaemon CPU set, and
+// export the VERBOSE level for the scripts we start. Returns whether
+// judge backend debugging is enabled.
+
+[[noreturn]] __attribute__((format(printf, 1, 2))) void fatal(const char *format, ...);
+// Log an error on invalid usage or input and exit, without cleaning up.
+
+[[noreturn]] __attribute__((format(printf, 2, 3))) void fail(int errnum, const char *format, ...);
+// Log an unexpected error, with the description of errnum if nonzero,
+// and call cleanexit.
+
+bool is_regular(const std::string &path);
+bool is_executable(const std::string &path);
+
+off_t file_size(const std::string &path);
+// Size of a file, or -1 if it does not exist.
+
+int open_or_fail(const std::string &path, int flags, mode_t mode = 0666);
+// Open a file close-on-exec.
+
+void touch(const std::string &path);
+// Create a file if it does not exist and update its modification time.
+
+void chmod_add(const std::string &path, mode_t add);
+void chmod_remove(const std::string &path, mode_t remove);
+
+void make_dir(const std::string &path, mode_t mode, bool may_exist = false);
+// Create a directory with exactly the given mode.
+
+void write_all(int fd, const char *data, size_t len, const std::string &path);
+
+bool copy_file(const std::string &from, const std::string &to, bool fatal_errors = true);
+// Copy a file, replacing the destination. Returns false on errors if
+// these are not fatal.
+
+std::string read_file(const std::string &path);
+// The contents of a file, or empty if it cannot be read.
+
+std::string read_message(const std::string &path);
+// The contents of a file without trailing newlines, like `$(cat file)'.
+
+void append_file(const std::string &path, const std::string &data);
+
+void remove_tree(const std::string &path);
+// Remove a file or directory tree, like `rm -rf'.
+
+void chmod_tree(const std::string &path, mode_t remove);
+// Remove mode bits from all files and directories in a tree.
+
+std::map<std::string, std::string> read_meta(const std::string &path);
+// Read the `key: value' lines of a runguard metadata file.
+
+std::string dir_of(const std::string &path);
+std::string base_of(const std::string &path);
+
+// Restrictions for a command that is not run under runguard: the CPUs
+// it may run on, its CPU time in seconds and its memory in kB, each
+// unrestricted if not set.
+struct limits_t {
+  const cpu_set_t *cpus;
+  double cputime;
+  long memsize;
+};
+
+pid_t spawn(const std::vector<std::string> &cmd, int in, int out, int err, bool err2out = false,
+            const limits_t *limits = nullptr);
+// Start a command with its stdin/stdout/stderr connected to the given
+// file descriptors, or inherited for -1. If err2out is set, its stderr
+// goes to its stdout. The limits are set right after starting it, like
+// runguard's: it gets a SIGXCPU when it exceeds its CPU time, and a
+// SIGKILL a second later.
+
+int wait_for(pid_t pid);
+// Wait for a command and return its exitcode like the shell does.
+
+int run(const std::vector<std::string> &cmd, int in, int out, int err, bool err2out = false,
+        const limits_t *limits = nullptr);
+// Start a command and wait for it.
+
+extern volatile sig_atomic_t terminated;
+// Set when a SIGTERM was received after calling catch_sigterm.
+
+void catch_sigterm();
+// Handle SIGTERM by setting terminated and passing it on to the command
+// that run() is waiting for, so that the judgedaemon can cancel a
+// judging without waiting for its time limit.
+
+#endif /* JUDGE_COMMON_H */
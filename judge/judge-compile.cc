@@ -0,0 +1,299 @@
+/*
+  judge-compile -- compile a submission.
+
+  Part of the DOMjudge Programming Contest Jury System and licensed
+  under the GNU GPL. See README and COPYING for details.
+
+
+  Program specifications:
+
+  Usage: judge-compile [-n CPUSET] <compile_script> <workdir> <file>...
+
+  <compile_script>  Absolute path to compile script.
+  <workdir>         Base directory of this judging. Compilation is done in
+                    <workdir>/compile, compiler output is stored in <workdir>.
+  <file>...         Source file(s) to be compiled. Files are passed in the
+                    same order as specified during submission. It is up to the
+                    specific compiler script to interpret how to compile this;
+                    the first file should conventionally be interpreted as the
+                    "main" file.
+
+  Returns with exit status 0 on success, or 'compiler-error' (see
+  EXITCODES in etc/judgehost-static.php), or 'internal-error' if
+  defined, else 1.
+
+  Syntax for the compile scripts is:
+
+    <compile_script> <dest> <memlimit> <source file>...
+
+  where <dest> is the filename of a resulting executable file that the
+  compile script must create. This executable should run the submission
+  in some way; compilation is considered failed if <dest> is not created
+  or not executable.
+  The <memlimit> (in kB, obtained from the environment) is passed to
+  the compile script to let interpreted languages (read: Oracle (Sun)
+  javac/java) be able to set the internal maximum memory size.
+
+  The result is considered a compilation failure if <dest> was not
+  created or is not executable or if the script returned a nonzero
+  exitcode. If any output line starts with "internal-error: ", this is
+  seen as an internal error in the compile script instead.
+
+  The directory of the compile script is the one the judgedaemon
+  prepared for its hash, and shared by all submissions compiled with
+  it. It is not copied, but bind mounted read-only at /compile-script
+  by runguard.
+*/
+
+#include "config.h"
+
+#include "judge-common.h"
+#include "lib.error.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pwd.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+const char *progname;
+
+string workdir;
+
+void cleanup() {
+  if (!workdir.empty()) {
+    chmod_remove(workdir + "/compile", 077);
+    chmod_remove(workdir + "/compile-script", 077);
+  }
+}
+
+void cleanexit(int status) {
+  // Prevent recursion if cleaning up fails.
+  static bool exiting = false;
+  if (!exiting) {
+    exiting = true;
+    cleanup();
+  }
+  logmsg(LOG_DEBUG, "exiting, code = '%d'", status);
+  exit(status);
+}
+
+// Whether a line of compiler output starts with `internal-error: ',
+// in any case.
+bool is_internal_error(const string &line) {
+  return strncasecmp(line.c_str(), "internal-error: ", 16) == 0;
+}
+
+// Whether a line of compiler output reports an auto-detected entry point.
+bool is_entry_point(const string &line) {
+  return line.find("Detected entry_point: ") != string::npos ||
+         line.find("detected entry_point: ") != string::npos;
+}
+
+vector<string> split_lines(const string &data) {
+  vector<string> lines;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    size_t eol = data.find('\n', pos);
+    if (eol == string::npos) eol = data.size();
+    lines.push_back(data.substr(pos, eol - pos));
+    pos = eol + 1;
+  }
+  return lines;
+}
+
+// Write compile.out with a message followed by the compiler output.
+[[noreturn]] void compile_result(const string &msg, const string &output, int status) {
+  int fd = open_or_fail("compile.out", O_WRONLY | O_CREAT | O_TRUNC);
+  string data = msg + "\n" + output;
+  write_all(fd, data.data(), data.size(), "compile.out");
+  close(fd);
+  cleanexit(status);
+}
+
+int main(int argc, char **argv) {
+  progname = argv[0];
+
+  // Do argument parsing
+  string cpuset;
+  int opt;
+  opterr = 0;
+  while ((opt = getopt(argc, argv, "+n:")) != -1) {
+    switch (opt) {
+    case 'n':
+      cpuset = optarg;
+      break;
+    default:
+      fprintf(stderr, "Invalid option specified.\n");
+      exit(1);
+    }
+  }
+
+  bool debug = init_logging(cpuset);
+
+  // Location of scripts/programs:
+  string runguard = env("DJ_BINDIR") + "/runguard";
+
+  logmsg(LOG_INFO, "starting '%s', PID = %d", argv[0], (int)getpid());
+
+  if (argc - optind < 3) {
+    fatal("not enough arguments. See program source for usage.");
+  }
+  string compile_script = argv[optind];
+  string dir = argv[optind + 1];
+  vector<string> sources(argv + optind + 2, argv + argc);
+  string sources_str;
+  for (const auto &src : sources) {
+    sources_str += (sources_str.empty() ? "" : " ") + src;
+  }
+  logmsg(LOG_DEBUG, "arguments: '%s' '%s'", compile_script.c_str(), dir.c_str());
+  logmsg(LOG_DEBUG, "source file(s): %s", sources_str.c_str());
+
+  struct stat s;
+  if (stat(dir.c_str(), &s) != 0 || !S_ISDIR(s.st_mode) ||
+      access(dir.c_str(), W_OK | X_OK) != 0) {
+    fatal("Workdir not found or not writable: %s", dir.c_str());
+  }
+  if (!is_executable(compile_script)) {
+    fatal("compile script not found or not executable: %s", compile_script.c_str());
+  }
+  if (!is_executable(runguard)) {
+    fatal("runguard not found or not executable: %s", runguard.c_str());
+  }
+
+  if (chdir(dir.c_str()) != 0) {
+    fatal("cannot change to workdir: %s", dir.c_str());
+  }
+  char *cwd = getcwd(nullptr, 0);
+  if (cwd == nullptr) fatal("cannot get working directory");
+  workdir = cwd;
+  free(cwd);
+
+  // Make compile dir accessible and writable for RUNUSER:
+  chmod_add("compile", 0777);
+
+  // Create files which are expected to exist: compiler output and runtime
+  touch("compile.out");
+  touch("compile.meta");
+
+  // Mount point of the compile script directory in the chroot.
+  make_dir("compile-script", 0755, true);
+
+  if (chdir("compile") != 0) {
+    fail(errno, "cannot change to compile directory");
+  }
+
+  for (const auto &src : sources) {
+    if (access(src.c_str(), R_OK) != 0) {
+      fail(0, "source file not found: %s", src.c_str());
+    }
+    // Make source(s) readable (in case it is interpreted):
+    chmod_add(src, 0444);
+  }
+
+  logmsg(LOG_INFO, "starting compile");
+
+  // First compile to 'source' then rename to 'program' to avoid problems with
+  // the compiler writing to different filenames and deleting intermediate files.
+  vector<string> cmd = {"sudo", "-n", runguard};
+  if (debug) cmd.push_back("-v");
+  if (!cpuset.empty()) cmd.insert(cmd.end(), {"-P", cpuset});
+  cmd.insert(cmd.end(), {
+    "-u", env("RUNUSER"), "-g", env("RUNGROUP"),
+    "-r", workdir, "-d", "/compile",
+    "-B", dir_of(compile_script) + ":/compile-script",
+    "-m", env("SCRIPTMEMLIMIT"), "-t", env("SCRIPTTIMELIMIT"), "--no-core",
+    "-f", env("SCRIPTFILELIMIT"), "-s", env("SCRIPTFILELIMIT"),
+    "-M", workdir + "/compile.meta"});
+  if (!env("ENTRY_POINT").empty()) cmd.insert(cmd.end(), {"-V", "ENTRY_POINT=" + env("ENTRY_POINT")});
+  if (debug) cmd.insert(cmd.end(), {"-V", "DEBUG=" + env("DEBUG")});
+  cmd.insert(cmd.end(), {"--", "/compile-script/" + base_of(compile_script),
+                         "program", env("MEMLIMIT")});
+  cmd.insert(cmd.end(), sources.begin(), sources.end());
+
+  int out = open_or_fail(workdir + "/compile.tmp", O_WRONLY | O_CREAT | O_TRUNC);
+  int exitcode = run(cmd, -1, out, -1, true);
+  close(out);
+
+  // Make sure that all files are owned by the current user/group, so
+  // that we can delete the judging output tree without root access.
+  // We also remove group RUNGROUP so that this can safely be shared
+  // across multiple judgedaemons, and remove write permissions.
+  struct passwd *pw = getpwuid(geteuid());
+  string user = pw != nullptr ? pw->pw_name : to_string(geteuid());
+  if (run({"sudo", "-n", "chown", "-R", user + ":", workdir + "/compile"}, -1, -1, -1) != 0) {
+    fail(0, "cannot change owner of `compile'");
+  }
+  chmod_tree(workdir + "/compile", 022);
+
+  if (chdir(workdir.c_str()) != 0) {
+    fail(errno, "cannot change to workdir");
+  }
+
+  string output = read_file("compile.tmp");
+  vector<string> lines = split_lines(output);
+
+  if (exitcode != 0 && file_size("compile.meta") <= 0) {
+    append_file("compile.meta", "internal-error: runguard crashed\n");
+    compile_result("Runguard exited with code " + to_string(exitcode) +
+                   " and 'compile.meta' is empty, it likely crashed.\nCompilation output:",
+                   output, exitcode_for("E_INTERNAL_ERROR"));
+  }
+  string internal_errors;
+  for (const auto &line : lines) {
+    if (is_internal_error(line)) {
+      internal_errors += "internal-error: compile script:" + line.substr(15) + "\n";
+    }
+  }
+  if (!internal_errors.empty()) {
+    append_file("compile.meta", internal_errors);
+    compile_result("The compile script threw an internal error. Compilation output:",
+                   output, exitcode_for("E_INTERNAL_ERROR"));
+  }
+
+  // Check if the compile script auto-detected the entry point, and if
+  // so, store it in the compile.meta for later reuse, e.g. in a replay.
+  string entry_points;
+  for (const auto &line : lines) {
+    if (is_entry_point(line)) {
+      entry_points += line.substr(line.rfind("etected ") + 8) + "\n";
+    }
+  }
+  if (!entry_points.empty()) {
+    append_file("compile.meta", entry_points);
+  }
+
+  logmsg(LOG_DEBUG, "checking compilation exit-status");
+  if (read_meta("compile.meta")["time-result"].find("timelimit") != string::npos) {
+    compile_result("Compiling aborted after " + env("SCRIPTTIMELIMIT") +
+                   " seconds, compiler output:",
+                   output, exitcode_for("E_COMPILER_ERROR"));
+  }
+  if (exitcode != 0) {
+    compile_result("Compiling failed with exitcode " + to_string(exitcode) +
+                   ", compiler output:",
+                   output, exitcode_for("E_COMPILER_ERROR"));
+  }
+  if (!is_regular("compile/program") || access("compile/program", X_OK) != 0) {
+    compile_result("Compiling failed: no executable was created; compiler output:",
+                   output, exitcode_for("E_COMPILER_ERROR"));
+  }
+
+  // Remove any entry point detection message when compilation succeeded,
+  // since we already stored it above and it only confuses contestants.
+  string filtered;
+  for (const auto &line : lines) {
+    if (!is_entry_point(line)) {
+      filtered += line + "\n";
+    }
+  }
+  append_file("compile.out", filtered);
+
+  logmsg(LOG_INFO, "Compilation successful");
+  cleanexit(0);
+}
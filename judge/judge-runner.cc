@@ -0,0 +1,785 @@
+/*
+  judge-runner -- run and compare a submission on a single testcase.
+
+  Part of the DOMjudge Programming Contest Jury System and licensed
+  under the GNU GPL. See README and COPYING for details.
+
+
+  Program specifications:
+
+  Usage: judge-runner [-n CPUSET] [-p PASSES] <testdata.in> <testdata.out>
+                      <timelimit> <workdir> <run> <compare> <compare-args>
+
+  <testdata.in>     File containing test-input with absolute pathname.
+  <testdata.out>    File containing test-output with absolute pathname.
+  <timelimit>       Timelimit in seconds, optionally followed by ':' and
+                    the hard limit to kill still running submissions.
+  <workdir>         Directory where to execute submission in a chroot-ed
+                    environment. For best security leave it as empty as
+                    possible. Certainly do not place output-files there!
+  <run>             Absolute path to run script to use.
+  <compare>         Absolute path to compare script to use, optional.
+  <compare-args>    Arguments to pass to compare script, optional.
+
+  With -p, the testcase is run in up to PASSES passes of a multi-pass
+  problem, each in its own directory 1, 2, ... of <workdir>, with links
+  to the program in <workdir>/execdir. A pass that is correct and for
+  which the validator wrote feedback/nextpass.in is followed by a pass
+  with that as input. Every pass leaves its own output and metadata in
+  its directory; the exitcode is that of the last pass.
+
+  Default run and compare scripts can be configured in the database.
+
+  The limits, users and exitcodes are passed through the environment by
+  the judgedaemon. The program exits with one of the E_* exitcodes for
+  the verdict, E_COMPARE_ERROR if the compare script failed, or 127 on
+  internal errors.
+
+  This does all the work around running a testcase in-process: only the
+  run script (which calls runguard under sudo), the compare script, and
+  where needed a `chown' under sudo are started as separate processes.
+*/
+
+#include "config.h"
+
+#include "judge-common.h"
+#include "lib.error.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <map>
+#include <pwd.h>
+#include <sched.h>
+#include <signal.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+const char *progname;
+
+string testin, testout, timelimit, workdir, run_script, compare_script;
+vector<string> compare_args;
+string cpuset;
+int pass_limit = 0;
+
+// Location of scripts/programs, set up in main().
+string scriptdir, runguard, default_compare;
+const string program = "execdir/program";
+
+// How to run and compare, the same for all passes.
+bool debug, combined_run_compare, native_compare, stream;
+cpu_set_t compare_cpus;
+
+// The natively run default compare gets the same CPUs and limits as
+// runguard would give a compare script.
+cpu_set_t run_cpus;
+limits_t compare_limits = {nullptr, 0, 0};
+
+// The working directory as the shell would see it after `cd workdir',
+// i.e. without resolving symlinks.
+string pwd;
+
+// A compare script started before the run, reading the program output
+// while it is written.
+pid_t stream_pid = -1;
+
+bool in_workdir = false;
+
+// Minimal MD5 (RFC 1321), to check the default scripts against their
+// checksums as written by `md5sum'.
+string md5_file(const string &path) {
+  static const uint32_t K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+  static const int R[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return "";
+  }
+  string data;
+  char buf[65536];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    data.append(buf, n);
+  }
+  close(fd);
+  if (n < 0) {
+    return "";
+  }
+
+  uint64_t bits = (uint64_t)data.size() * 8;
+  data += '\x80';
+  while (data.size() % 64 != 56) data += '\0';
+  for (int i = 0; i < 8; i++) data += (char)(bits >> (8 * i));
+
+  uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+  for (size_t off = 0; off < data.size(); off += 64) {
+    uint32_t M[16];
+    for (int i = 0; i < 16; i++) {
+      const unsigned char *p = (const unsigned char *)data.data() + off + 4 * i;
+      M[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    for (int i = 0; i < 64; i++) {
+      uint32_t f;
+      int g;
+      if (i < 16) {
+        f = (b & c) | (~b & d); g = i;
+      } else if (i < 32) {
+        f = (d & b) | (~d & c); g = (5 * i + 1) % 16;
+      } else if (i < 48) {
+        f = b ^ c ^ d; g = (3 * i + 5) % 16;
+      } else {
+        f = c ^ (b | ~d); g = (7 * i) % 16;
+      }
+      uint32_t x = a + f + K[i] + M[g];
+      int r = R[(i / 16) * 4 + i % 4];
+      a = d; d = c; c = b;
+      b = b + ((x << r) | (x >> (32 - r)));
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+  }
+
+  string hex;
+  char digits[3];
+  for (int i = 0; i < 16; i++) {
+    snprintf(digits, sizeof(digits), "%02x", (h[i / 4] >> (8 * (i % 4))) & 0xff);
+    hex += digits;
+  }
+  return hex;
+}
+
+// Check the files in a directory against a list of checksums as written
+// by `md5sum', like `md5sum -c'.
+bool md5_check(const string &sumfile, const string &dir) {
+  string sums = read_file(sumfile);
+  if (sums.empty()) {
+    return false;
+  }
+  size_t pos = 0;
+  while (pos < sums.size()) {
+    size_t eol = sums.find('\n', pos);
+    if (eol == string::npos) eol = sums.size();
+    string line = sums.substr(pos, eol - pos);
+    pos = eol + 1;
+    if (line.size() < 35 || line[32] != ' ') {
+      return false;
+    }
+    if (md5_file(dir + "/" + line.substr(34)) != line.substr(0, 32)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parse a list of CPUs like `taskset -c' does.
+bool parse_cpulist(const string &list, cpu_set_t *set) {
+  CPU_ZERO(set);
+  const char *p = list.c_str();
+  while (*p) {
+    char *end;
+    long from = strtol(p, &end, 10), to = from;
+    if (end == p) return false;
+    if (*end == '-') {
+      p = end + 1;
+      to = strtol(p, &end, 10);
+      if (end == p) return false;
+    }
+    if (from < 0 || to < from || to >= CPU_SETSIZE) return false;
+    for (long cpu = from; cpu <= to; cpu++) CPU_SET(cpu, set);
+    if (*end == ',') end++;
+    else if (*end != 0) return false;
+    p = end;
+  }
+  return true;
+}
+
+// The CPUs for helper work next to a run, such as a streaming compare:
+// those that the judgedaemon reserved for it (HOUSEKEEPING_CPUS) and we
+// may run on, except the CPUs of this run. Any other CPU may be timing
+// a submission of another judgedaemon. Returns false if no CPU is left.
+bool spare_cpus(cpu_set_t *spare) {
+  cpu_set_t allowed, busy;
+  string housekeeping = env("HOUSEKEEPING_CPUS");
+  if (housekeeping.empty() || !parse_cpulist(housekeeping, spare)) return false;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return false;
+  CPU_AND(spare, spare, &allowed);
+  if (!cpuset.empty()) {
+    if (!parse_cpulist(cpuset, &busy)) return false;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &busy)) CPU_CLR(cpu, spare);
+    }
+  }
+  return CPU_COUNT(spare) > 0;
+}
+
+// Give the natively run default compare the token index of the testdata
+// output at path: link it if it is cached next to the testdata, otherwise
+// give it an empty file to build it in. Other compare scripts do not get
+// an index, since we could not trust what they leave there.
+void link_index(const string &path) {
+  string cached = testout + ".idx";
+  unlink(path.c_str());
+  if (file_size(cached) > 0) {
+    if (link(cached.c_str(), path.c_str()) != 0) {
+      copy_file(cached, path);
+    }
+  } else {
+    close(open_or_fail(path, O_WRONLY | O_CREAT | O_EXCL, 0600));
+  }
+}
+
+// Cache an index that the default compare newly built. Copy it, so that
+// the cached index is not linked into the workdir of this judging.
+void cache_index(const string &path) {
+  string cached = testout + ".idx";
+  if (file_size(path) > 0 && access(cached.c_str(), F_OK) != 0) {
+    string tmp = cached + "." + to_string(getpid());
+    if (!copy_file(path, tmp, false) || rename(tmp.c_str(), cached.c_str()) != 0) {
+      unlink(tmp.c_str());
+      logmsg(LOG_WARNING, "failed to cache testdata output index");
+    }
+  }
+}
+
+void cleanup() {
+  // Stop a streaming compare that is still running
+  if (stream_pid > 0) {
+    kill(stream_pid, SIGTERM);
+    waitpid(stream_pid, nullptr, 0);
+    stream_pid = -1;
+  }
+
+  if (!in_workdir) {
+    return;
+  }
+
+  // Replace testdata by symlinks to reduce disk usage
+  if (is_regular("testdata.in")) {
+    unlink("testdata.in");
+    if (symlink(testin.c_str(), "testdata.in") != 0) {
+      logmsg(LOG_WARNING, "cannot link testdata.in: %s", strerror(errno));
+    }
+  }
+  if (is_regular("testdata.out")) {
+    unlink("testdata.out");
+    if (symlink(testout.c_str(), "testdata.out") != 0) {
+      logmsg(LOG_WARNING, "cannot link testdata.out: %s", strerror(errno));
+    }
+  }
+  unlink("testdata.out.idx");
+  remove_tree("streamdir");
+
+  // Remove access to workdir for next runs
+  chmod_remove(pwd, 077);
+
+  // Copy runguard and program stderr to system output. The display is
+  // truncated to normal size in the jury web interface.
+  string runguard_err = read_file("runguard.err");
+  if (!runguard_err.empty()) {
+    append_file("system.out", "********** runguard stderr follows **********\n" + runguard_err);
+  }
+  in_workdir = false;
+}
+
+void cleanexit(int status) {
+  // Prevent recursion if cleaning up fails.
+  static bool exiting = false;
+  if (!exiting) {
+    exiting = true;
+    cleanup();
+  }
+  logmsg(LOG_DEBUG, "exiting with status '%d'", status);
+  exit(status);
+}
+
+// Append a verdict with the resource usage to system.out and return
+// its exitcode.
+int verdict(const string &msg, const string &resourceinfo, int status) {
+  append_file("system.out", msg + "\n" + resourceinfo + "\n");
+  return status;
+}
+
+void usage_error() {
+  fatal("not enough arguments. See program source for usage.");
+}
+
+// Run the program in dir and compare its output, leaving the output
+// and metadata there. Returns the exitcode for the verdict; the caller
+// cleans up the directory.
+int run_pass(const string &dir) {
+  if (chdir(dir.c_str()) != 0) {
+    fatal("cannot change to workdir: %s", dir.c_str());
+  }
+  in_workdir = true;
+  if (dir[0] == '/') {
+    pwd = dir;
+  } else {
+    char *cwd = getcwd(nullptr, 0);
+    if (cwd == nullptr) fail(errno, "cannot get working directory");
+    pwd = cwd;
+    free(cwd);
+  }
+  while (pwd.size() > 1 && pwd.back() == '/') pwd.pop_back();
+
+  // Get the last two directory entries of the workdir
+  char *parent = realpath((pwd + "/..").c_str(), nullptr);
+  if (parent == nullptr) fail(errno, "cannot resolve parent of workdir");
+  string prefix = "/" + base_of(parent) + "/" + base_of(pwd);
+  free(parent);
+
+  // Make testing/execute dir accessible for RUNUSER:
+  chmod_add(pwd, 0111);
+  chmod_add(pwd + "/execdir", 0111);
+
+  // Create files which are expected to exist:
+  for (const char *file : {"system.out", "program.out", "program.err",
+                           "program.meta", "runguard.err", "compare.meta",
+                           "compare.err"}) {
+    touch(file);
+  }
+
+  logmsg(LOG_INFO, "setting up testing (chroot) environment");
+
+  // Copy the testdata input
+  copy_file(testin, "testdata.in");
+
+  make_dir("../../bin", 0711, true);
+  make_dir("../../dev", 0711, true);
+
+  // If we need to create a writable temp directory, do so
+  bool writable_temp_dir = !env("CREATE_WRITABLE_TEMP_DIR").empty();
+  if (writable_temp_dir) {
+    setenv("TMPDIR", (prefix + "/write_tmp").c_str(), 1);
+    make_dir("write_tmp", 0777, true);
+  }
+
+  // Run the solution program (within a restricted environment):
+  logmsg(LOG_INFO, "running program");
+
+  vector<string> cmd = {run_script, "testdata.in", "program.out"};
+  if (combined_run_compare) {
+    // A combined run and compare script may now already need the
+    // feedback directory, and perhaps access to the test answers (but
+    // only the original that lives outside the chroot).
+    if (mkdir("feedback", 0777) != 0) {
+      fail(errno, "cannot create directory `feedback'");
+    }
+    cmd.insert(cmd.end(), {testout, "compare.meta", "feedback"});
+  }
+
+  // Start the streaming compare on a FIFO that runguard copies the
+  // program output to. Everything the compare script needs is in a
+  // directory that is not accessible from the chroot. We keep the FIFO
+  // open for writing during the run, so the compare script does not see
+  // the end of its input before runguard opens it. It runs on a spare
+  // CPU with the same limits as the compare after the run.
+  int fifo_wr = -1;
+  string tee_opt;
+  if (stream) {
+    remove_tree("streamdir");
+    make_dir("streamdir", 0700);
+    make_dir("streamdir/feedback", 0700);
+    if (symlink(testout.c_str(), "streamdir/testdata.out") != 0) {
+      fail(errno, "cannot link testdata output");
+    }
+    link_index("streamdir/testdata.out.idx");
+    if (mkfifo("streamdir/program.fifo", 0600) != 0) {
+      fail(errno, "cannot create FIFO");
+    }
+    int fifo_rd = open_or_fail("streamdir/program.fifo", O_RDONLY | O_NONBLOCK);
+    fifo_wr = open_or_fail("streamdir/program.fifo", O_WRONLY | O_NONBLOCK);
+    if (fcntl(fifo_rd, F_SETFL, 0) != 0) fail(errno, "cannot set FIFO flags");
+    int tmp = open_or_fail("streamdir/compare.tmp", O_WRONLY | O_CREAT | O_TRUNC);
+
+    logmsg(LOG_DEBUG, "starting streaming compare");
+    vector<string> compare_cmd = {default_compare, "testdata.in",
+                                  "streamdir/testdata.out", "streamdir/feedback/"};
+    compare_cmd.insert(compare_cmd.end(), compare_args.begin(), compare_args.end());
+    limits_t stream_limits = compare_limits;
+    stream_limits.cpus = &compare_cpus;
+    stream_pid = spawn(compare_cmd, fifo_rd, tmp, -1, true, &stream_limits);
+    close(fifo_rd);
+    close(tmp);
+    tee_opt = "--stdout-tee=" + pwd + "/streamdir/program.fifo";
+  }
+
+  string filelimit = env("FILELIMIT");
+  cmd.insert(cmd.end(), {"sudo", "-n", runguard});
+  if (debug) cmd.insert(cmd.end(), {"-v", "-V", "DEBUG=" + env("DEBUG")});
+  if (!env("TMPDIR").empty()) cmd.insert(cmd.end(), {"-V", "TMPDIR=" + env("TMPDIR")});
+  if (!cpuset.empty()) cmd.insert(cmd.end(), {"-P", cpuset});
+  cmd.insert(cmd.end(), {
+    "-r", pwd + "/../..",
+    "--nproc=" + env("PROCLIMIT"),
+    "--no-core", "--streamsize=" + filelimit,
+    "--user=" + env("RUNUSER"), "--group=" + env("RUNGROUP"),
+    "--walltime=" + timelimit, "--cputime=" + timelimit,
+    "--memsize=" + env("MEMLIMIT"), "--filesize=" + filelimit,
+    "--stderr=program.err", "--outmeta=program.meta"});
+  if (!tee_opt.empty()) cmd.push_back(tee_opt);
+  cmd.insert(cmd.end(), {"--", prefix + "/" + program});
+
+  int runguard_err = open_or_fail("runguard.err", O_WRONLY | O_CREAT | O_TRUNC);
+  int exitcode = run(cmd, -1, -1, runguard_err);
+  close(runguard_err);
+  if (fifo_wr >= 0) close(fifo_wr);
+  if (terminated) {
+    logmsg(LOG_NOTICE, "terminated, not comparing output");
+    cleanexit(E_INTERNAL);
+  }
+
+  string user = getpwuid(geteuid()) ? getpwuid(geteuid())->pw_name : to_string(geteuid());
+  if (writable_temp_dir) {
+    // Revoke access to the temp directory as security measure
+    if (run({"sudo", "-n", "chown", "-R", user + ":", pwd + "/write_tmp"}, -1, -1, -1) != 0) {
+      fail(0, "cannot change owner of `write_tmp'");
+    }
+    chmod_tree("write_tmp", 077);
+  }
+
+  // Use the verdict of the streaming compare if it has seen exactly what
+  // the run script wrote to program.out, otherwise compare that file.
+  bool streamed = false;
+  if (stream_pid > 0) {
+    string tee_bytes = read_meta("program.meta")["stdout-tee-bytes"];
+    if (!tee_bytes.empty() && tee_bytes == to_string(file_size("program.out"))) {
+      exitcode = wait_for(stream_pid);
+      stream_pid = -1;
+      if (exitcode == 42 || exitcode == 43) {
+        logmsg(LOG_DEBUG, "using streaming compare result");
+        streamed = true;
+        if (rename("streamdir/feedback", "feedback") != 0 ||
+            rename("streamdir/compare.tmp", "compare.tmp") != 0) {
+          fail(errno, "cannot move streaming compare results");
+        }
+        cache_index("streamdir/testdata.out.idx");
+      } else {
+        logmsg(LOG_WARNING, "streaming compare failed with exitcode %d, comparing program.out", exitcode);
+      }
+    } else {
+      logmsg(LOG_DEBUG, "program output not streamed, comparing program.out");
+      kill(stream_pid, SIGTERM);
+      waitpid(stream_pid, nullptr, 0);
+      stream_pid = -1;
+    }
+  }
+
+  if (!combined_run_compare && !streamed) {
+    // We first compare the output, so that even if the submission gets a
+    // timelimit exceeded or runtime error verdict later, the jury can
+    // still view the diff with what the submission produced.
+    logmsg(LOG_INFO, "comparing output");
+
+    // Copy testdata output, only after program has run
+    copy_file(testout, "testdata.out");
+
+    // The default compare script can use an index of the tokens in the
+    // testdata output.
+    if (native_compare) link_index("testdata.out.idx");
+
+    logmsg(LOG_DEBUG, "starting compare script '%s'", compare_script.c_str());
+
+    // Create dir for feedback files and make it writable for RUNUSER
+    make_dir("feedback", 0755);
+    chmod_add("feedback", 0222);
+
+    int in = open_or_fail("program.out", O_RDONLY);
+    int out = open_or_fail("compare.tmp", O_WRONLY | O_CREAT | O_TRUNC);
+    vector<string> compare_cmd;
+    if (native_compare) {
+      logmsg(LOG_DEBUG, "running default compare natively");
+      compare_cmd = {default_compare};
+    } else {
+      compare_cmd = {"sudo", "-n", runguard};
+      if (debug) compare_cmd.push_back("-v");
+      if (!cpuset.empty()) compare_cmd.insert(compare_cmd.end(), {"-P", cpuset});
+      compare_cmd.insert(compare_cmd.end(), {
+        "-u", env("RUNUSER"), "-g", env("RUNGROUP"),
+        "-m", env("SCRIPTMEMLIMIT"), "-t", env("SCRIPTTIMELIMIT"), "--no-core",
+        "-f", env("SCRIPTFILELIMIT"), "-s", env("SCRIPTFILELIMIT"),
+        "-M", "compare.meta", "--", compare_script});
+    }
+    compare_cmd.insert(compare_cmd.end(), {"testdata.in", "testdata.out", "feedback/"});
+    compare_cmd.insert(compare_cmd.end(), compare_args.begin(), compare_args.end());
+    exitcode = run(compare_cmd, in, out, -1, true, native_compare ? &compare_limits : nullptr);
+    close(in);
+    close(out);
+
+    if (native_compare) {
+      // Report exceeding the CPU time limit like runguard does.
+      if (exitcode == 128 + SIGXCPU || exitcode == 128 + SIGKILL) {
+        append_file("compare.meta", "time-result: hard-timelimit\n");
+      }
+      cache_index("testdata.out.idx");
+    }
+  }
+
+  // Make sure that all feedback files are owned by the current
+  // user/group, so that we can append content. This is only needed
+  // if the compare script ran as another user.
+  if (!native_compare) {
+    if (run({"sudo", "-n", "chown", "-R", user + ":", pwd + "/feedback"}, -1, -1, -1) != 0) {
+      fail(0, "cannot change owner of `feedback'");
+    }
+  }
+  chmod_tree("feedback", 022);
+
+  // Make sure that feedback file exists, since we assume this later.
+  if (!is_regular("feedback/judgemessage.txt")) {
+    touch("feedback/judgemessage.txt");
+  }
+
+  // Append output validator error messages
+  // TODO: display extra
+  string judgeerror = read_file("feedback/judgeerror.txt");
+  if (!judgeerror.empty()) {
+    append_file("feedback/judgemessage.txt",
+                "\n---------- output validator (error) messages ----------\n" + judgeerror);
+  }
+
+  logmsg(LOG_DEBUG, "checking compare script exit-status: %d", exitcode);
+  map<string, string> compare_meta = read_meta("compare.meta");
+  if (compare_meta["time-result"].find("timelimit") != string::npos) {
+    logmsg(LOG_ERR, "Comparing aborted after %s seconds, compare script output:\n%s",
+           env("SCRIPTTIMELIMIT").c_str(), read_message("compare.tmp").c_str());
+    cleanexit(exitcode_for("E_COMPARE_ERROR"));
+  }
+  if (compare_meta["validator-time-result"].compare(0, 9, "timelimit") == 0) {
+    logmsg(LOG_ERR, "Validator exceeded its time budget of %s seconds, validator output:\n%s",
+           env("SCRIPTTIMELIMIT").c_str(), read_message("feedback/judgemessage.txt").c_str());
+    cleanexit(exitcode_for("E_COMPARE_ERROR"));
+  }
+  // Append output validator stdin/stderr - display extra?
+  string compare_tmp = read_file("compare.tmp");
+  if (!compare_tmp.empty()) {
+    append_file("feedback/judgemessage.txt",
+                "\n---------- output validator stdout/stderr messages ----------\n" + compare_tmp);
+  }
+  if (exitcode != 42 && exitcode != 43) {
+    logmsg(LOG_ERR, "Comparing failed with exitcode %d, compare script output:\n%s",
+           exitcode, read_message("feedback/judgemessage.txt").c_str());
+    cleanexit(exitcode_for("E_COMPARE_ERROR"));
+  }
+
+  // Check for errors from running the program:
+  if (access("program.meta", R_OK) != 0) {
+    fatal("'program.meta' not readable");
+  }
+  logmsg(LOG_DEBUG, "checking program run exit-status");
+  map<string, string> meta = read_meta("program.meta");
+  string program_exit = meta["exitcode"];
+  string resourceinfo = "runtime: " + meta["cpu-time"] + "s cpu, " +
+                        meta["wall-time"] + "s wall\n" +
+                        "memory used: " + meta["memory-bytes"] + " bytes";
+  bool timelimit_reached = meta["time-result"].find("timelimit") != string::npos;
+
+  if (combined_run_compare && compare_meta["validator-exited-first"] == "true" &&
+      compare_meta["exitcode"] == "43") {
+    // For interactive problems with combined run/compare scripts, a
+    // WA may override TLE and RTE.
+    string msg;
+    if (timelimit_reached) {
+      msg = "Timelimit exceeded, but validator exited first with WA.\n";
+    } else if (program_exit != "0") {
+      msg = "Non-zero exitcode " + program_exit + ", but validator exited first with WA.\n";
+    }
+    append_file("system.out", msg + resourceinfo + "\n");
+    return exitcode_for("E_WRONG_ANSWER");
+  }
+
+  if (timelimit_reached) {
+    return verdict("Timelimit exceeded.", resourceinfo, exitcode_for("E_TIMELIMIT"));
+  }
+  if (program_exit != "0") {
+    return verdict("Non-zero exitcode " + program_exit, resourceinfo, exitcode_for("E_RUN_ERROR"));
+  }
+
+  string truncated = "," + meta["output-truncated"] + ",";
+  if (truncated.find(",stdout,") != string::npos) {
+    return verdict("Output limit exceeded: " + meta["stdout-bytes"] + " > " +
+            to_string(atoll(filelimit.c_str()) * 1024),
+            resourceinfo, exitcode_for("E_OUTPUT_LIMIT"));
+  }
+
+  if (exitcode == 42) {
+    return verdict("Correct!", resourceinfo, exitcode_for("E_CORRECT"));
+  }
+  // Special case detect no-output:
+  if (file_size("program.out") <= 0 && !combined_run_compare) {
+    return verdict("Program produced no output.", resourceinfo, exitcode_for("E_NO_OUTPUT"));
+  }
+  return verdict("Wrong answer.", resourceinfo, exitcode_for("E_WRONG_ANSWER"));
+}
+
+int main(int argc, char **argv) {
+  progname = argv[0];
+  catch_sigterm();
+
+  // Do argument parsing
+  int opt;
+  opterr = 0;
+  while ((opt = getopt(argc, argv, "+n:p:")) != -1) {
+    switch (opt) {
+    case 'n':
+      cpuset = optarg;
+      break;
+    case 'p':
+      pass_limit = atoi(optarg);
+      if (pass_limit <= 0) {
+        fprintf(stderr, "Invalid number of passes specified.\n");
+        exit(1);
+      }
+      break;
+    default:
+      fprintf(stderr, "Invalid option specified.\n");
+      exit(1);
+    }
+  }
+
+  debug = init_logging(cpuset);
+
+  // Location of scripts/programs:
+  scriptdir = env("DJ_LIBJUDGEDIR");
+  runguard = env("DJ_BINDIR") + "/runguard";
+  default_compare = env("DJ_BINDIR") + "/default_compare";
+
+  logmsg(LOG_INFO, "starting '%s', PID = %d", argv[0], (int)getpid());
+
+  if (argc - optind < 4) usage_error();
+  testin = argv[optind];
+  testout = argv[optind + 1];
+  timelimit = argv[optind + 2];
+  workdir = argv[optind + 3];
+  if (argc - optind > 4) run_script = argv[optind + 4];
+  if (argc - optind > 5) compare_script = argv[optind + 5];
+  string compare_args_str = argc - optind > 6 ? argv[optind + 6] : "";
+  logmsg(LOG_DEBUG, "arguments: '%s' '%s' '%s' '%s'", testin.c_str(),
+         testout.c_str(), timelimit.c_str(), workdir.c_str());
+  logmsg(LOG_DEBUG, "optionals: '%s' '%s' '%s'", run_script.c_str(),
+         compare_script.c_str(), compare_args_str.c_str());
+
+  // The compare arguments are split on whitespace, like the shell does.
+  size_t pos = 0;
+  while ((pos = compare_args_str.find_first_not_of(" \t\n", pos)) != string::npos) {
+    size_t end = compare_args_str.find_first_of(" \t\n", pos);
+    compare_args.push_back(compare_args_str.substr(pos, end - pos));
+    pos = end;
+  }
+
+  if (access(testin.c_str(), R_OK) != 0) fatal("test-input not found: %s", testin.c_str());
+  if (access(testout.c_str(), R_OK) != 0) fatal("test-output not found: %s", testout.c_str());
+  struct stat s;
+  if (stat(workdir.c_str(), &s) != 0 || !S_ISDIR(s.st_mode) ||
+      access(workdir.c_str(), W_OK | X_OK) != 0) {
+    fatal("Workdir not found or not writable: %s", workdir.c_str());
+  }
+  combined_run_compare = compare_script.empty();
+  setenv("COMBINED_RUN_COMPARE", combined_run_compare ? "1" : "0", 1);
+  if (!is_executable(workdir + "/" + program)) {
+    fatal("submission program not found or not executable: '%s/%s'",
+          workdir.c_str(), program.c_str());
+  }
+  if (!is_executable(run_script)) fatal("run script not found or not executable: %s", run_script.c_str());
+  if (!is_executable(runguard)) fatal("runguard not found or not executable: %s", runguard.c_str());
+  if (!combined_run_compare && !is_executable(compare_script)) {
+    fatal("compare script not found or not executable: %s", compare_script.c_str());
+  }
+
+  // The unmodified default compare script is our own code, so it can
+  // run directly as a native binary, without sudo and runguard.
+  native_compare = !combined_run_compare && is_executable(default_compare) &&
+                   md5_check(scriptdir + "/default_compare.md5", dir_of(compare_script));
+
+  if (!cpuset.empty() && !parse_cpulist(cpuset, &run_cpus)) {
+    fatal("invalid CPU set: %s", cpuset.c_str());
+  }
+
+  if (native_compare) {
+    if (!cpuset.empty()) compare_limits.cpus = &run_cpus;
+    compare_limits.cputime = atof(env("SCRIPTTIMELIMIT").c_str());
+    compare_limits.memsize = atol(env("SCRIPTMEMLIMIT").c_str());
+  }
+
+  // The native default compare can read the program output while it is
+  // being written, if the unmodified default run script writes it.
+  stream = native_compare && md5_check(scriptdir + "/default_run.md5", dir_of(run_script));
+  if (stream && !spare_cpus(&compare_cpus)) {
+    logmsg(LOG_DEBUG, "no spare CPU for a streaming compare");
+    stream = false;
+  }
+
+  // An interactive run script can pass on the interaction with less
+  // latency by busy-polling, which must then happen on a spare CPU. The
+  // spare CPUs are reserved for this judgedaemon, and we spread its
+  // parallel runs over them by the CPU they run on.
+  cpu_set_t proxy_cpus;
+  unsetenv("PROXY_CPU");
+  if (spare_cpus(&proxy_cpus)) {
+    vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &proxy_cpus)) cpus.push_back(cpu);
+    }
+    size_t pick = 0;
+    if (!cpuset.empty()) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &run_cpus)) {
+          pick = cpu % cpus.size();
+          break;
+        }
+      }
+    }
+    setenv("PROXY_CPU", to_string(cpus[pick]).c_str(), 1);
+  }
+
+  if (pass_limit == 0) {
+    cleanexit(run_pass(workdir));
+  }
+
+  // The pass directories are below the workdir, and we change into
+  // each of them in turn.
+  string base = workdir;
+  if (base[0] != '/') {
+    char *cwd = getcwd(nullptr, 0);
+    if (cwd == nullptr) fail(errno, "cannot get working directory");
+    base = string(cwd) + "/" + workdir;
+    free(cwd);
+  }
+
+  int status;
+  for (int pass = 1; ; pass++) {
+    logmsg(LOG_INFO, "running pass %d", pass);
+    string passdir = base + "/" + to_string(pass);
+    make_dir(passdir, 0755, true);
+    // A relative link to the program also resolves inside the chroot.
+    if (symlink("../execdir", (passdir + "/execdir").c_str()) != 0 && errno != EEXIST) {
+      fail(errno, "cannot link program to `%s'", passdir.c_str());
+    }
+
+    status = run_pass(passdir);
+    cleanup();
+
+    string nextpass = passdir + "/feedback/nextpass.in";
+    if (status != exitcode_for("E_CORRECT") || pass >= pass_limit || !is_regular(nextpass)) {
+      break;
+    }
+    testin = nextpass;
+  }
+  cleanexit(status);
+}
@@ -268,12 +268,21 @@ $waittime = INITIAL_WAITTIME_SEC;
 
 const SCRIPT_ID = 'judgedaemon';
 const CHROOT_SCRIPT = 'chroot-startstop.sh';
+// At most this many kB of chroot libraries are prefetched at startup.
+const PREWARM_LIBS_MAX_KB = 256 * 1024;
 
 function usage(): never
 {
     echo "Usage: " . SCRIPT_ID . " [OPTION]...\n" .
         "Start the judgedaemon.\n\n" .
         "  -n <id>           bind to CPU <id> and user " . RUNUSER . "-<id>\n" .
+        "  --parallel <cpus> run the testcases of a judging in parallel, one on\n" .
+        "                      each CPU in the list <cpus> (e.g. '2-5' or '2,4'),\n" .
+        "                      as user " . RUNUSER . "-<cpu>\n" .
+        "  --housekeeping <cpus>\n" .
+        "                    do helper work such as comparing output while it\n" .
+        "                      is written on the CPUs <cpus>, which must be\n" .
+        "                      reserved for this judgedaemon\n" .
         "  --diskspace-error send internal error on low diskspace; if not set,\n" .
         "                      the judgedaemon will try to clean up and continue\n" .
         "  -v <level>        set verbosity to <level>; these are syslog levels:\n" .
@@ -283,6 +292,24 @@ function usage(): never
     exit;
 }
 
+// Expand a list of CPUs like '0-3,8' into the CPU numbers, or return
+// null if it is not a valid list.
+function parse_cpulist(string $list): ?array
+{
+    $cpus = [];
+    foreach (explode(',', $list) as $range) {
+        if (!preg_match('/^(\d+)(?:-(\d+))?$/', $range, $matches)) {
+            return null;
+        }
+        $last = $matches[2] ?? $matches[1];
+        if ((int)$last < (int)$matches[1]) {
+            return null;
+        }
+        $cpus = array_merge($cpus, range((int)$matches[1], (int)$last));
+    }
+    return array_values(array_unique($cpus));
+}
+
 function read_judgehostlog(int $numLines = 20) : string
 {
     ob_start();
@@ -477,10 +504,11 @@ function fetch_executable_internal(
         }
         if ($combined_run_compare) {
             # For combined run and compare (i.e. for interactive problems), we
-            # need to wrap the jury provided 'run' script with 'runpipe' to
-            # handle the bidirectional communication.  First 'run' is renamed to
+            # need to wrap the jury provided 'run' script to handle the
+            # bidirectional communication.  First 'run' is renamed to
             # 'runjury', and then replaced by the script below, which runs the
-            # team submission and runjury programs and connects their pipes.
+            # team submission under runguard's interactive mode with runjury
+            # as the validator connected to its pipes.
             $runscript = file_get_contents(LIBJUDGEDIR . '/run-interactive.sh');
             if (rename($execrunpath, $execrunjurypath) === false) {
                 disable('judgehost', 'hostname', $myhost, "Could not move file 'run' to 'runjury' in $execbuilddir");
@@ -502,7 +530,7 @@ function fetch_executable_internal(
     return [$execrunpath, null, null];
 }
 
-$options = getopt("dv:n:hVe:j:t:", ["diskspace-error"]);
+$options = getopt("dv:n:hVe:j:t:", ["diskspace-error", "parallel:", "housekeeping:"]);
 // We can't fully trust the output of getopt, it has outstanding bugs:
 // https://bugs.php.net/search.php?cmd=display&search_for=getopt&x=0&y=0
 if ($options===false) {
@@ -538,6 +566,32 @@ if (isset($options['daemonid'])) {
     }
 }
 
+// The CPUs to run testcases on in parallel, if more than one.
+$parallelCpus = [];
+if (isset($options['parallel'])) {
+    $parallelCpus = parse_cpulist($options['parallel']);
+    if ($parallelCpus === null) {
+        echo "Invalid value for parallel, must be a list of CPUs like '2-5' or '2,4'.\n";
+        exit(1);
+    }
+}
+
+// The CPUs that helper work may run on while submissions are timed.
+$housekeepingCpus = [];
+if (isset($options['housekeeping'])) {
+    $housekeepingCpus = parse_cpulist($options['housekeeping']);
+    if ($housekeepingCpus === null) {
+        echo "Invalid value for housekeeping, must be a list of CPUs like '6' or '6,7'.\n";
+        exit(1);
+    }
+    $judgeCpus = !empty($parallelCpus) ? $parallelCpus :
+        (isset($options['daemonid']) ? [(int)$options['daemonid']] : []);
+    if (!empty(array_intersect($housekeepingCpus, $judgeCpus))) {
+        echo "Housekeeping CPUs must not be used to run submissions on.\n";
+        exit(1);
+    }
+}
+
 define('LOGFILE', LOGDIR.'/judge.'.$myhost.'.log');
 require(LIBDIR . '/lib.error.php');
 
@@ -576,6 +630,12 @@ putenv('DJ_LOGDIR='      . LOGDIR);
 putenv('RUNUSER='        . $runuser);
 putenv('RUNGROUP='       . RUNGROUP);
 
+// Only CPUs explicitly reserved for it may take helper work off the
+// CPUs that submissions are timed on.
+if (!empty($housekeepingCpus)) {
+    putenv('HOUSEKEEPING_CPUS=' . implode(',', $housekeepingCpus));
+}
+
 foreach ($EXITCODES as $code => $name) {
     $var = 'E_' . strtoupper(str_replace('-', '_', $name));
     putenv($var . '=' . $code);
@@ -605,11 +665,20 @@ if (empty($options['e'])) {
         error("cannot write PID to '" . LOCKFILE . "'");
     }
 
-    $output = [];
-    exec("ps -u '$runuser' -o pid= -o comm=", $output, $retval);
-    if (count($output) !== 0) {
-        error("found processes still running as '$runuser', check manually:\n" .
-            implode("\n", $output));
+    $runusers = [$runuser];
+    foreach ($parallelCpus as $cpu) {
+        $runusers[] = RUNUSER . '-' . $cpu;
+        if (!posix_getpwnam(RUNUSER . '-' . $cpu)) {
+            error("runuser " . RUNUSER . "-$cpu does not exist.");
+        }
+    }
+    foreach (array_unique($runusers) as $user) {
+        $output = [];
+        exec("ps -u '$user' -o pid= -o comm=", $output, $retval);
+        if (count($output) !== 0) {
+            error("found processes still running as '$user', check manually:\n" .
+                implode("\n", $output));
+        }
     }
 
     logmsg(LOG_NOTICE, "Judge started on $myhost [DOMjudge/" . DOMJUDGE_VERSION . "]");
@@ -657,6 +726,11 @@ if ($retval!==0) {
     error("chroot validation check exited with exitcode $retval");
 }
 
+// Read the libraries in the chroot into the cache, so the first runs do
+// not show inflated runtimes. Only up to a bound, since a full chroot can
+// be larger than what the page cache should give to it.
+prewarm([CHROOTDIR . '/usr/lib'], PREWARM_LIBS_MAX_KB);
+
 foreach ($endpoints as $id => $endpoint) {
     $endpointID = $id;
     registerJudgehost($myhost);
@@ -684,6 +758,7 @@ foreach ($domserver_languages as $language) {
 $endpointIDs = array_keys($endpoints);
 $currentEndpoint = 0;
 $lastWorkdir = null;
+$lastWorkdirStart = null;
 while (true) {
     // If all endpoints are waiting, sleep for a bit.
     $dosleep = true;
@@ -785,7 +860,7 @@ while (true) {
         if (! $endpoints[$endpointID]["waiting"]) {
             $endpoints[$endpointID]["waiting"] = true;
             if ($lastWorkdir !== null) {
-                cleanup_judging($lastWorkdir);
+                cleanup_judging($lastWorkdir, $lastWorkdirStart);
                 $lastWorkdir = null;
             }
             logmsg(LOG_INFO, "No submissions in queue (for endpoint $endpointID), waiting...");
@@ -821,7 +896,7 @@ while (true) {
 
     if ($type == 'prefetch') {
         if ($lastWorkdir !== null) {
-            cleanup_judging($lastWorkdir);
+            cleanup_judging($lastWorkdir, $lastWorkdirStart);
             $lastWorkdir = null;
         }
         foreach ($row as $judgeTask) {
@@ -855,7 +930,7 @@ while (true) {
 
     if ($type == 'debug_info') {
         if ($lastWorkdir !== null) {
-            cleanup_judging($lastWorkdir);
+            cleanup_judging($lastWorkdir, $lastWorkdirStart);
             $lastWorkdir = null;
         }
         foreach ($row as $judgeTask) {
@@ -938,7 +1013,7 @@ while (true) {
     }
 
     if ($needs_cleanup && $lastWorkdir !== null) {
-        cleanup_judging($lastWorkdir);
+        cleanup_judging($lastWorkdir, $lastWorkdirStart);
         $lastWorkdir = null;
     }
 
@@ -948,6 +1023,8 @@ while (true) {
         error("Could not create '$workdir/compile'");
     }
 
+    // Make sure the workdir is accessible for the domjudge-run user.
+    // Will be revoked again after this run finished.
     chmod($workdir, 0755);
 
     if (!chdir($workdir)) {
@@ -955,6 +1032,9 @@ while (true) {
     }
 
     if ($lastWorkdir !== $workdir) {
+        // Files written from here on belong to this workdir.
+        $workdirStart = microtime(true);
+
         // create chroot environment
         logmsg(LOG_INFO, "  🔒 Executing chroot script: '".CHROOT_SCRIPT." start'");
         system(LIBJUDGEDIR.'/'.CHROOT_SCRIPT.' start', $retval);
@@ -968,24 +1048,35 @@ while (true) {
         djconfig_refresh();
 
         $lastWorkdir = $workdir;
+        $lastWorkdirStart = $workdirStart;
     }
 
-    // Make sure the workdir is accessible for the domjudge-run user.
-    // Will be revoked again after this run finished.
-    foreach ($row as $judgetask) {
-        if (!judge($judgetask)) {
-            // Potentially return remaining outstanding judgetasks here.
-            $returnedJudgings = request('judgehosts', 'POST', 'hostname=' . urlencode($myhost), false);
-            if ($returnedJudgings !== null) {
-                $returnedJudgings = dj_json_decode($returnedJudgings);
-                foreach ($returnedJudgings as $jud) {
-                    $workdir = judging_directory($workdirpath, $jud);
-                    @chmod($workdir, 0700);
-                    logmsg(LOG_WARNING, "  🔙 Returned unfinished judging with jobid " . $jud['jobid'] .
-                        " in my name; given back unfinished runs from me.");
-                }
+    $finished = true;
+    $passLimit = dj_json_decode($row[0]['run_config'])['pass_limit'] ?? 1;
+    if (count($parallelCpus) > 1 && count($row) > 1 && $passLimit == 1) {
+        $finished = judge_parallel(array_values($row), $parallelCpus);
+    } else {
+        // Read in all testcases before the first run, so that no run
+        // waits for disk I/O.
+        prewarm_testcases($row);
+        foreach ($row as $judgetask) {
+            if (!judge($judgetask)) {
+                $finished = false;
+                break;
+            }
+        }
+    }
+    if (!$finished) {
+        // Potentially return remaining outstanding judgetasks here.
+        $returnedJudgings = request('judgehosts', 'POST', 'hostname=' . urlencode($myhost), false);
+        if ($returnedJudgings !== null) {
+            $returnedJudgings = dj_json_decode($returnedJudgings);
+            foreach ($returnedJudgings as $jud) {
+                $workdir = judging_directory($workdirpath, $jud);
+                @chmod($workdir, 0700);
+                logmsg(LOG_WARNING, "  🔙 Returned unfinished judging with jobid " . $jud['jobid'] .
+                    " in my name; given back unfinished runs from me.");
             }
-            break;
         }
     }
 
@@ -1091,7 +1182,8 @@ function read_metadata(string $filename): ?array
     return $res;
 }
 
-function cleanup_judging(string $workdir) : void
+// Clean up after judging in $workdir, which started at time $since.
+function cleanup_judging(string $workdir, ?float $since = null) : void
 {
     global $myhost;
     // revoke readablity for domjudge-run user to this workdir
@@ -1109,13 +1201,54 @@ function cleanup_judging(string $workdir) : void
         // starting.
     }
 
-    // Evict all contents of the workdir from the kernel fs cache
-    system(LIBJUDGEDIR . '/evict ' . dj_escapeshellarg($workdir), $retval);
+    // Evict the files written while judging from the kernel fs cache.
+    // Testcases and executables shared with the next judgings are only
+    // linked from the workdir, or were written before it started.
+    // File timestamps use a coarse clock, so allow some slack.
+    $evict_opts = '--no-dereference';
+    if ($since !== null) {
+        $evict_opts .= ' --since=' . sprintf('%.6F', $since - 1);
+    }
+    system(LIBJUDGEDIR . '/evict ' . $evict_opts . ' ' . dj_escapeshellarg($workdir), $retval);
     if ($retval!==0) {
         warning("evict script exited with exitcode $retval");
     }
 }
 
+// Prefetch files and directories into the kernel fs cache, so that runs
+// using them do not have to wait for disk I/O. This is done in the
+// foreground, so call it only when no run is being timed. At most
+// $maxSizeKb kB is read if given.
+function prewarm(array $paths, ?int $maxSizeKb = null) : void
+{
+    $paths = array_filter($paths, 'file_exists');
+    if (empty($paths)) {
+        return;
+    }
+    $opts = $maxSizeKb !== null ? "--max-size=$maxSizeKb " : '';
+    exec(LIBJUDGEDIR . '/prewarm ' . $opts . implode(' ', array_map('dj_escapeshellarg', $paths)) .
+        ' > /dev/null 2>&1', $output, $retval);
+    if ($retval !== 0) {
+        logmsg(LOG_WARNING, "prewarm exited with exitcode $retval");
+    }
+}
+
+// Fetch the testcases of the judge tasks if needed, and prefetch them
+// into the fs cache.
+function prewarm_testcases(array $judgeTasks) : void
+{
+    global $workdirpath;
+
+    $paths = [];
+    foreach ($judgeTasks as $judgeTask) {
+        $tcfile = fetchTestcase($workdirpath, $judgeTask['testcase_id'], $judgeTask['judgetaskid'], $judgeTask['testcase_hash']);
+        if ($tcfile !== null) {
+            $paths[] = dirname($tcfile['input']);
+        }
+    }
+    prewarm($paths);
+}
+
 function compile(
     array $judgeTask,
     string $workdir,
@@ -1238,7 +1371,7 @@ function compile(
     }
 
     // Compile the program.
-    $compile_cmd = LIBJUDGEDIR . "/compile.sh $cpuset_opt " .
+    $compile_cmd = LIBJUDGEDIR . "/judge-compile $cpuset_opt " .
         implode(' ', array_map('dj_escapeshellarg', array_merge([
             $execrunpath,
             $workdir,
@@ -1315,9 +1448,12 @@ function compile(
     return true;
 }
 
-function judge(array $judgeTask): bool
+// Prepare running a judge task: compile the submission if needed, and
+// fetch the testcase and the run and compare scripts. Returns what is
+// needed to run the task, or null if the judging cannot continue.
+function setup_judgetask(array $judgeTask, string $cpuset_opt): ?array
 {
-    global $EXITCODES, $myhost, $options, $workdirpath, $exitsignalled, $gracefulexitsignalled, $endpointID;
+    global $myhost, $workdirpath, $exitsignalled, $gracefulexitsignalled;
 
     $compile_config = dj_json_decode($judgeTask['compile_config']);
     $run_config     = dj_json_decode($judgeTask['run_config']);
@@ -1341,15 +1477,10 @@ function judge(array $judgeTask): bool
     }
     $output_storage_limit = (int) djconfig_get_value('output_storage_limit');
 
-    $cpuset_opt = "";
-    if (isset($options['daemonid'])) {
-        $cpuset_opt = '-n ' . dj_escapeshellarg($options['daemonid']);
-    }
-
     $workdir = judging_directory($workdirpath, $judgeTask);
     $compile_success = compile($judgeTask, $workdir, $workdirpath, $compile_config, $cpuset_opt, $output_storage_limit);
     if (!$compile_success) {
-        return false;
+        return null;
     }
 
     // TODO: How do we plan to handle these?
@@ -1369,7 +1500,7 @@ function judge(array $judgeTask): bool
             logmsg(LOG_WARNING, "Aborted judging task " . $jud['judgetaskid'] .
                    " due to signal");
         }
-        return false;
+        return null;
     }
 
     logmsg(LOG_INFO, "  🏃 Running testcase $judgeTask[testcase_id]...");
@@ -1377,7 +1508,7 @@ function judge(array $judgeTask): bool
     $tcfile = fetchTestcase($workdirpath, $judgeTask['testcase_id'], $judgeTask['judgetaskid'], $judgeTask['testcase_hash']);
     if ($tcfile === null) {
         // error while fetching testcase
-        return false;
+        return null;
     }
 
     // do the actual test-run
@@ -1390,11 +1521,11 @@ function judge(array $judgeTask): bool
         $judgeTask['judgetaskid'],
         $combined_run_compare);
     if (isset($error)) {
-        return false;
+        return null;
     }
 
     if ($combined_run_compare) {
-        // set to empty string to signal the testcase_run script that the
+        // set to empty string to signal judge-runner that the
         // run script also acts as compare script
         $compare_runpath = '';
     } else {
@@ -1406,7 +1537,7 @@ function judge(array $judgeTask): bool
             $judgeTask['judgetaskid']
         );
         if (isset($error)) {
-            return false;
+            return null;
         }
     }
 
@@ -1427,119 +1558,133 @@ function judge(array $judgeTask): bool
     putenv('SCRIPTMEMLIMIT='  . $compare_config['script_memory_limit']);
     putenv('SCRIPTFILELIMIT=' . $compare_config['script_filesize_limit']);
 
-    $input = $tcfile['input'];
-    $output = $tcfile['output'];
-    $passLimit = $run_config['pass_limit'] ?? 1;
-    for ($passCnt = 1; $passCnt <= $passLimit; $passCnt++) {
-        $nextPass = false;
-        if ($passLimit > 1) {
-            logmsg(LOG_INFO, "    🔄 Running pass $passCnt...");
-        }
-
-        $passdir = $testcasedir . '/' . $passCnt;
-        mkdir($passdir, 0755, true);
+    // Copy program with all possible additional files to testcase
+    // dir. Use hardlinks to preserve space with big executables. This is
+    // done only once for all passes, which judge-runner links to it: the
+    // program directory is not writable for the run user, so passes
+    // cannot influence each other through it.
+    $programdir = $testcasedir . '/execdir';
+    system('mkdir -p ' . dj_escapeshellarg($programdir), $retval);
+    if ($retval!==0) {
+        error("Could not create directory '$programdir'");
+    }
 
-        // Copy program with all possible additional files to testcase
-        // dir. Use hardlinks to preserve space with big executables.
-        $programdir = $passdir . '/execdir';
-        system('mkdir -p ' . dj_escapeshellarg($programdir), $retval);
+    foreach (glob("$workdir/compile/*") as $compile_file) {
+        system('cp -PRl ' . dj_escapeshellarg($compile_file) . ' ' . dj_escapeshellarg($programdir), $retval);
         if ($retval!==0) {
-            error("Could not create directory '$programdir'");
-        }
-
-        foreach (glob("$workdir/compile/*") as $compile_file) {
-            system('cp -PRl ' . dj_escapeshellarg($compile_file) . ' ' . dj_escapeshellarg($programdir), $retval);
-            if ($retval!==0) {
-                error("Could not copy program to '$programdir'");
-            }
-        }
-
-        $test_run_cmd = LIBJUDGEDIR . "/testcase_run.sh $cpuset_opt " .
-            implode(' ', array_map('dj_escapeshellarg', [
-                $input,
-                $output,
-                "$run_config[time_limit]:$hardtimelimit",
-                $passdir,
-                $run_runpath,
-                $compare_runpath,
-                $compare_config['compare_args']
-            ]));
-        system($test_run_cmd, $retval);
-
-        // What does the exitcode mean?
-        if (!isset($EXITCODES[$retval])) {
-            alert('error');
-            error("Unknown exitcode ($retval) from testcase_run.sh for s$judgeTask[submitid]");
+            error("Could not copy program to '$programdir'");
         }
-        $result = $EXITCODES[$retval];
+    }
 
-        // Try to read metadata from file
-        $runtime = null;
-        $metadata = read_metadata($passdir . '/program.meta');
+    return [
+        'testcasedir' => $testcasedir,
+        'input' => $tcfile['input'],
+        'output' => $tcfile['output'],
+        'timelimit' => "$run_config[time_limit]:$hardtimelimit",
+        'pass_limit' => $run_config['pass_limit'] ?? 1,
+        'run_runpath' => $run_runpath,
+        'compare_runpath' => $compare_runpath,
+        'compare_args' => $compare_config['compare_args'],
+        'combined_run_compare' => $combined_run_compare,
+        'output_storage_limit' => $output_storage_limit,
+    ];
+}
 
-        if (isset($metadata['time-used'])) {
-            $runtime = @$metadata[$metadata['time-used']];
-        }
+// Return the judge-runner command line to run all passes of a judge
+// task, each in its own directory below the testcase directory.
+function judge_runner_cmd(array $task, ?string $cpuset): array
+{
+    return array_merge(
+        [LIBJUDGEDIR . '/judge-runner'],
+        $cpuset === null ? [] : ['-n', $cpuset],
+        [
+            '-p', (string)$task['pass_limit'],
+            $task['input'],
+            $task['output'],
+            $task['timelimit'],
+            $task['testcasedir'],
+            $task['run_runpath'],
+            $task['compare_runpath'],
+            $task['compare_args']
+        ]
+    );
+}
 
-        if ($result === 'compare-error') {
-            $compareMeta = read_metadata($passdir . '/compare.meta');
-            $compareExitCode = 'n/a';
-            if (isset($compareMeta['exitcode'])) {
-                $compareExitCode = $compareMeta['exitcode'];
-            }
-            if ($combined_run_compare) {
-                logmsg(LOG_ERR, "comparing failed for combined run/compare script '" . $judgeTask['run_script_id'] . "'");
-                $description = 'combined run/compare script ' . $judgeTask['run_script_id'] . ' crashed with exit code ' . $compareExitCode . ", expected one of 42/43";
-                disable('run_script', 'run_script_id', $judgeTask['run_script_id'], $description, $judgeTask['judgetaskid']);
-            } else {
-                logmsg(LOG_ERR, "comparing failed for compare script '" . $judgeTask['compare_script_id'] . "'");
-                logmsg(LOG_ERR, "compare script meta data:\n" . dj_file_get_contents($passdir . '/compare.meta'));
-                $description = 'compare script ' . $judgeTask['compare_script_id'] . ' crashed with exit code ' . $compareExitCode . ", expected one of 42/43";
-                disable('compare_script', 'compare_script_id', $judgeTask['compare_script_id'], $description, $judgeTask['judgetaskid']);
-            }
-            return false;
-        }
+// Interpret the judge-runner exitcode of a pass. Returns the result, the
+// runtime, the run metadata and the judging run to report, or null if
+// the compare script failed and has been disabled.
+function pass_result(array $judgeTask, array $task, string $passdir, int $retval): ?array
+{
+    global $EXITCODES, $myhost;
 
-        $new_judging_run = [
-            'runresult' => urlencode($result),
-            'runtime' => urlencode((string)$runtime),
-            'output_run' => rest_encode_file($passdir . '/program.out', $output_storage_limit),
-            'output_error' => rest_encode_file($passdir . '/program.err', $output_storage_limit),
-            'output_system' => rest_encode_file($passdir . '/system.out', $output_storage_limit),
-            'metadata' => rest_encode_file($passdir . '/program.meta', false),
-            'output_diff' => rest_encode_file($passdir . '/feedback/judgemessage.txt', $output_storage_limit),
-            'hostname' => $myhost,
-            'testcasedir' => $testcasedir,
-            'compare_metadata' => rest_encode_file($passdir . '/compare.meta', false),
-        ];
+    // What does the exitcode mean?
+    if (!isset($EXITCODES[$retval])) {
+        alert('error');
+        error("Unknown exitcode ($retval) from judge-runner for s$judgeTask[submitid]");
+    }
+    $result = $EXITCODES[$retval];
 
-        if (file_exists($passdir . '/feedback/teammessage.txt')) {
-            $new_judging_run['team_message'] = rest_encode_file($passdir . '/feedback/teammessage.txt', $output_storage_limit);
-        }
+    // Try to read metadata from file
+    $runtime = null;
+    $metadata = read_metadata($passdir . '/program.meta');
 
-        if ($passLimit > 1) {
-            $walltime = $metadata['wall-time'] ?? '?';
-            logmsg(LOG_INFO, ' ' . ($result === 'correct' ? "   \033[0;32m✔\033[0m" : "   \033[1;31m✗\033[0m")
-                . '  ...done in ' . $walltime . 's (CPU: ' . $runtime . 's), result: ' . $result);
-        }
+    if (isset($metadata['time-used'])) {
+        $runtime = @$metadata[$metadata['time-used']];
+    }
 
-        if ($result !== 'correct') {
-            break;
+    if ($result === 'compare-error') {
+        $compareMeta = read_metadata($passdir . '/compare.meta');
+        $compareExitCode = 'n/a';
+        if (isset($compareMeta['exitcode'])) {
+            $compareExitCode = $compareMeta['exitcode'];
         }
-        if (file_exists($passdir . '/feedback/nextpass.in')) {
-            $input = $passdir . '/feedback/nextpass.in';
-            $nextPass = true;
+        if ($task['combined_run_compare']) {
+            logmsg(LOG_ERR, "comparing failed for combined run/compare script '" . $judgeTask['run_script_id'] . "'");
+            $description = 'combined run/compare script ' . $judgeTask['run_script_id'] . ' crashed with exit code ' . $compareExitCode . ", expected one of 42/43";
+            disable('run_script', 'run_script_id', $judgeTask['run_script_id'], $description, $judgeTask['judgetaskid']);
         } else {
-            break;
+            logmsg(LOG_ERR, "comparing failed for compare script '" . $judgeTask['compare_script_id'] . "'");
+            logmsg(LOG_ERR, "compare script meta data:\n" . dj_file_get_contents($passdir . '/compare.meta'));
+            $description = 'compare script ' . $judgeTask['compare_script_id'] . ' crashed with exit code ' . $compareExitCode . ", expected one of 42/43";
+            disable('compare_script', 'compare_script_id', $judgeTask['compare_script_id'], $description, $judgeTask['judgetaskid']);
         }
+        return null;
     }
-    if ($nextPass) {
-        $description = 'validator produced more passes than allowed ($passLimit)';
-        disable('compare_script', 'compare_script_id', $judgeTask['compare_script_id'], $description, $judgeTask['judgetaskid']);
-        return false;
+
+    $output_storage_limit = $task['output_storage_limit'];
+    $new_judging_run = [
+        'runresult' => urlencode($result),
+        'runtime' => urlencode((string)$runtime),
+        'output_run' => rest_encode_file($passdir . '/program.out', $output_storage_limit),
+        'output_error' => rest_encode_file($passdir . '/program.err', $output_storage_limit),
+        'output_system' => rest_encode_file($passdir . '/system.out', $output_storage_limit),
+        'metadata' => rest_encode_file($passdir . '/program.meta', false),
+        'output_diff' => rest_encode_file($passdir . '/feedback/judgemessage.txt', $output_storage_limit),
+        'hostname' => $myhost,
+        'testcasedir' => $task['testcasedir'],
+        'compare_metadata' => rest_encode_file($passdir . '/compare.meta', false),
+    ];
+
+    if (file_exists($passdir . '/feedback/teammessage.txt')) {
+        $new_judging_run['team_message'] = rest_encode_file($passdir . '/feedback/teammessage.txt', $output_storage_limit);
     }
 
-    $ret = true;
+    return [$result, $runtime, $metadata, $new_judging_run];
+}
+
+function log_result(string $indent, string $result, ?array $metadata, ?string $runtime): void
+{
+    $walltime = $metadata['wall-time'] ?? '?';
+    logmsg(LOG_INFO, ' ' . $indent . ($result === 'correct' ? "\033[0;32m✔\033[0m" : "\033[1;31m✗\033[0m")
+        . '  ...done in ' . $walltime . 's (CPU: ' . $runtime . 's), result: ' . $result);
+}
+
+// Report the result of a judge task to the domserver. Returns whether
+// the remaining judge tasks of the judging should still be run.
+function report_result(array $judgeTask, string $result, array $new_judging_run): bool
+{
+    global $myhost, $endpointID;
+
     if ($result === 'correct') {
         // Post result back asynchronously. PHP is lacking multi-threading, so
         // we just call ourselves again.
@@ -1552,29 +1697,188 @@ function judge(array $judgeTask): bool
             . ' -j ' . $tmpfile
             . ' >> /dev/null & ';
         shell_exec($cmd);
-    } else {
-        // This run was incorrect, only continue with the remaining judge tasks
-        // if we are told to do so.
-        $needsMoreWork = request(
-            sprintf('judgehosts/add-judging-run/%s/%s', urlencode($myhost),
-                urlencode((string)$judgeTask['judgetaskid'])),
-            'POST',
-            $new_judging_run,
-            false
-        );
-        $ret = (bool)$needsMoreWork;
+        return true;
+    }
+
+    // This run was incorrect, only continue with the remaining judge tasks
+    // if we are told to do so.
+    $needsMoreWork = request(
+        sprintf('judgehosts/add-judging-run/%s/%s', urlencode($myhost),
+            urlencode((string)$judgeTask['judgetaskid'])),
+        'POST',
+        $new_judging_run,
+        false
+    );
+    return (bool)$needsMoreWork;
+}
+
+function judge(array $judgeTask): bool
+{
+    global $options, $EXITCODES;
+
+    $cpuset = $options['daemonid'] ?? null;
+    $cpuset_opt = "";
+    if (isset($cpuset)) {
+        $cpuset_opt = '-n ' . dj_escapeshellarg($cpuset);
+    }
+
+    $task = setup_judgetask($judgeTask, $cpuset_opt);
+    if ($task === null) {
+        return false;
+    }
+
+    $passLimit = $task['pass_limit'];
+    if ($passLimit > 1) {
+        logmsg(LOG_INFO, "    🔄 Running up to $passLimit passes...");
+    }
+
+    // judge-runner runs the passes one after another, until one is not
+    // correct or has no next pass. The exitcode is that of the last pass.
+    $test_run_cmd = implode(' ', array_map('dj_escapeshellarg',
+        judge_runner_cmd($task, $cpuset)));
+    system($test_run_cmd, $retval);
+
+    $correct = array_search('correct', $EXITCODES);
+    $nextPass = false;
+    for ($passCnt = 1; $passCnt <= $passLimit; $passCnt++) {
+        $passdir = $task['testcasedir'] . '/' . $passCnt;
+        $nextPass = file_exists($passdir . '/feedback/nextpass.in');
+        $lastPass = $passCnt == $passLimit || !$nextPass ||
+            !is_dir($task['testcasedir'] . '/' . ($passCnt + 1));
+
+        $pass = pass_result($judgeTask, $task, $passdir, $lastPass ? $retval : $correct);
+        if ($pass === null) {
+            return false;
+        }
+        [$result, $runtime, $metadata, $new_judging_run] = $pass;
+
+        if ($passLimit > 1) {
+            logmsg(LOG_INFO, "    🔄 Pass $passCnt:");
+            log_result('   ', $result, $metadata, $runtime);
+        }
+        if ($lastPass) {
+            $nextPass = $nextPass && $passCnt == $passLimit && $result === 'correct';
+            break;
+        }
+    }
+    if ($nextPass) {
+        $description = "validator produced more passes than allowed ($passLimit)";
+        disable('compare_script', 'compare_script_id', $judgeTask['compare_script_id'], $description, $judgeTask['judgetaskid']);
+        return false;
     }
 
+    $ret = report_result($judgeTask, $result, $new_judging_run);
+
     if ($passLimit == 1) {
-        $walltime = $metadata['wall-time'] ?? '?';
-        logmsg(LOG_INFO, ' ' . ($result === 'correct' ? " \033[0;32m✔\033[0m" : " \033[1;31m✗\033[0m")
-            . '  ...done in ' . $walltime . 's (CPU: ' . $runtime . 's), result: ' . $result);
+        log_result(' ', $result, $metadata, $runtime);
     }
 
     // done!
     return $ret;
 }
 
+// Run the judge tasks of one judging concurrently, one testcase per CPU
+// in $cpus, as its own run user. Results are still reported in testcase
+// order; when the domserver needs no more results (lazy judging), the
+// runs still in progress are terminated and their tasks given back.
+// Returns whether all tasks were judged or the judging was not needed
+// anymore, like judge() for a single task.
+function judge_parallel(array $row, array $cpus): bool
+{
+    global $options, $exitsignalled, $gracefulexitsignalled;
+
+    // The submission is compiled while setting up the first task, before
+    // any run is started, so it can use the CPU of the first run.
+    $cpuset_opt = '-n ' . dj_escapeshellarg((string)($options['daemonid'] ?? $cpus[0]));
+
+    // Read in all testcases before the first run is started: later the
+    // CPUs are never all idle.
+    prewarm_testcases($row);
+    $free = $cpus;
+    $running = [];
+    $results = [];
+    $next = 0;
+    $reported = 0;
+    $ret = true;
+
+    while ($reported < count($row)) {
+        // Start runs on the free CPUs, setting up the tasks in order.
+        while ($ret && $next < count($row) && !empty($free)) {
+            $judgeTask = $row[$next];
+            $task = setup_judgetask($judgeTask, $cpuset_opt);
+            if ($task === null) {
+                $ret = false;
+                break;
+            }
+            $cpu = array_shift($free);
+            $env = array_merge(getenv(), ['RUNUSER' => RUNUSER . '-' . $cpu]);
+            $proc = proc_open(judge_runner_cmd($task, (string)$cpu), [], $pipes, null, $env);
+            if ($proc === false) {
+                error("Could not start judge-runner for testcase $judgeTask[testcase_id]");
+            }
+            logmsg(LOG_DEBUG, "  Started testcase $judgeTask[testcase_id] on CPU $cpu.");
+            $running[$next] = ['proc' => $proc, 'cpu' => $cpu, 'task' => $task];
+            $next++;
+        }
+
+        // Collect finished runs.
+        foreach ($running as $i => $run) {
+            $status = proc_get_status($run['proc']);
+            if (!$status['running']) {
+                proc_close($run['proc']);
+                $results[$i] = [$run['task'], $status['exitcode']];
+                $free[] = $run['cpu'];
+                unset($running[$i]);
+            }
+        }
+
+        // Report the results that are next in order.
+        while ($ret && isset($results[$reported])) {
+            [$task, $retval] = $results[$reported];
+            $judgeTask = $row[$reported];
+            unset($results[$reported]);
+            $reported++;
+
+            $pass = pass_result($judgeTask, $task, $task['testcasedir'] . '/1', $retval);
+            if ($pass === null) {
+                $ret = false;
+                break;
+            }
+            [$result, $runtime, $metadata, $new_judging_run] = $pass;
+            $ret = report_result($judgeTask, $result, $new_judging_run);
+            log_result(' ', $result, $metadata, $runtime);
+        }
+
+        // Do not wait for the runs in progress on a hard exit signal.
+        if (function_exists('pcntl_signal_dispatch')) {
+            pcntl_signal_dispatch();
+        }
+        if ($exitsignalled && !$gracefulexitsignalled) {
+            logmsg(LOG_NOTICE, "Received HARD exit signal, aborting current judging.");
+            $ret = false;
+        }
+
+        if (!$ret) {
+            // Terminate the runs we do not need anymore. judge-runner passes
+            // this on to runguard, so they do not run to their time limit.
+            foreach ($running as $run) {
+                proc_terminate($run['proc']);
+                proc_close($run['proc']);
+            }
+            if (!empty($running)) {
+                logmsg(LOG_INFO, "  Terminated " . count($running) . " testcase runs in progress.");
+            }
+            return false;
+        }
+
+        if (!empty($running)) {
+            dj_sleep(0.005);
+        }
+    }
+
+    return true;
+}
+
 function fetchTestcase(string $workdirpath, string $testcase_id, int $judgetaskid, string $testcase_hash): ?array
 {
     // Get both in- and output files, only if we didn't have them already.
@@ -1610,6 +1914,13 @@ function fetchTestcase(string $workdirpath, string $testcase_id, int $judgetaski
     }
     unset($files);
 
+    // An index of the tokens in the output is built and cached next to it
+    // by the first compare run, see judge-runner.cc. Remove any index left
+    // from a previous download.
+    if (file_exists($tcfile['output'] . '.idx')) {
+        unlink($tcfile['output'] . '.idx');
+    }
+
     logmsg(LOG_INFO, "  💾 Fetched new testcase $testcase_id.");
     return $tcfile;
 }
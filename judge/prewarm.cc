@@ -0,0 +1,302 @@
+/*
+  prewarm -- report and prefetch files in the kernel filesystem cache.
+
+  Part of the DOMjudge Programming Contest Jury System and licensed
+  under the GNU GPL. See README and COPYING for details.
+
+
+  Program specifications:
+
+  This program walks the given files and directory trees and either
+  reports which fraction of their pages is resident in the page cache
+  (using mincore on a mapping of each file), or asks the kernel to read
+  them in (using readahead, falling back to POSIX_FADV_WILLNEED).
+
+  It is the counterpart of evict: the judgedaemon uses it to keep the
+  chroot libraries and the testcases of upcoming runs in the cache, so
+  that runs do not show runtimes inflated by disk I/O.
+*/
+
+#include "config.h"
+
+#include "lib.error.h"
+#include "lib.misc.h"
+
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <set>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#define PROGRAM "prewarm"
+#define VERSION DOMJUDGE_VERSION "/" REVISION
+
+using namespace std;
+
+const char *progname;
+
+void usage() {
+  printf("\
+Usage: %s [OPTION]... PATH...\n\
+Prefetch files and directory trees into the kernel filesystem cache, or\n\
+report how much of them is cached.\n\
+\n",
+         progname);
+  printf("\
+  -r, --report         report page cache residency instead of prefetching\n\
+  -m, --max-size=SIZE  prefetch at most SIZE kB in total\n\
+  -P, --no-dereference do not follow symbolic links inside directories\n\
+  -v, --verbose        display some extra warnings and information\n\
+  -h, --help           display this help and exit\n\
+      --version        output version information and exit\n\
+\n\
+Files reachable through multiple paths are only counted once.\n");
+  exit(0);
+}
+
+// Page counts of the files visited for one PATH argument.
+struct residency_t {
+  size_t files = 0;
+  size_t pages = 0;
+  size_t resident = 0;
+};
+
+struct state_t {
+  // Parsed command line arguments.
+  struct {
+    bool verbose = false;
+    int show_help = 0;
+    int show_version = 0;
+    bool report = false;
+    bool no_dereference = false;
+    long long max_bytes = -1;
+  } args;
+
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+
+  // Files already visited, by device and inode.
+  set<pair<dev_t, ino_t>> seen;
+
+  // Bytes prefetched so far, to enforce --max-size.
+  long long prefetched = 0;
+
+  // Buffer for the mincore result, reused between files.
+  vector<unsigned char> pages;
+
+  residency_t current;
+
+  state_t(int argc, char **argv) { parse_flags(argc, argv); }
+
+  void parse_flags(int argc, char **argv) {
+    // clang-format off
+    struct option const long_opts[] = {
+      {"report",   no_argument,       nullptr,            'r'},
+      {"max-size", required_argument, nullptr,            'm'},
+      {"no-dereference", no_argument, nullptr,            'P'},
+      {"verbose",  no_argument,       nullptr,            'v'},
+      {"help",     no_argument,       &args.show_help,    1  },
+      {"version",  no_argument,       &args.show_version, 1  },
+      { nullptr,   0,                 nullptr,             0 }
+    };
+    // clang-format on
+
+    progname = argv[0];
+    int opt = -1;
+    char *endptr = nullptr;
+    while ((opt = getopt_long(argc, argv, "+rm:Pvh", long_opts, NULL)) != -1) {
+      switch (opt) {
+      case 0: /* long-only option */
+        break;
+      case 'r': /* report option */
+        args.report = true;
+        break;
+      case 'm': /* max-size option */
+        args.max_bytes = strtoll(optarg, &endptr, 10);
+        if (*endptr != 0 || endptr == optarg || args.max_bytes < 0) {
+          error(0, "invalid size specified: `%s'", optarg);
+        }
+        args.max_bytes *= 1024;
+        break;
+      case 'P': /* no-dereference option */
+        args.no_dereference = true;
+        break;
+      case 'v': /* verbose option */
+        args.verbose = true;
+        verbose = LOG_DEBUG;
+        break;
+      case 'h':
+        args.show_help = 1;
+        break;
+      case ':': /* getopt error */
+      case '?':
+        error(0, "unknown option or missing argument `%c'", optopt);
+        break;
+      default:
+        error(0, "getopt returned character code `%c' ??", (char)opt);
+      }
+    }
+
+    if (args.show_help) {
+      usage();
+    }
+    if (args.show_version) {
+      version(PROGRAM, VERSION);
+    }
+
+    if (argc <= optind) {
+      error(0, "no path specified");
+    }
+    if (args.report && args.max_bytes >= 0) {
+      error(0, "--max-size cannot be used with --report");
+    }
+  }
+
+  // Count the pages of the file open at fd that are in the page cache.
+  void report_file(int fd, size_t size, const string &path) {
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      warning(errno, "unable to map file: %s", path.c_str());
+      return;
+    }
+    size_t npages = (size + page_size - 1) / page_size;
+    pages.resize(npages);
+    if (mincore(map, size, pages.data()) != 0) {
+      warning(errno, "unable to get residency of file: %s", path.c_str());
+      munmap(map, size);
+      return;
+    }
+    munmap(map, size);
+
+    size_t resident = 0;
+    for (unsigned char p : pages) {
+      resident += p & 1;
+    }
+    current.files++;
+    current.pages += npages;
+    current.resident += resident;
+    logmsg(LOG_DEBUG, "%zu/%zu pages resident: %s", resident, npages,
+           path.c_str());
+  }
+
+  // Ask the kernel to read in the file open at fd.
+  void prefetch_file(int fd, size_t size, const string &path) {
+    if (args.max_bytes >= 0 && prefetched + (long long)size > args.max_bytes) {
+      logmsg(LOG_DEBUG, "size limit reached, skipping file: %s", path.c_str());
+      return;
+    }
+    if (readahead(fd, 0, size) != 0) {
+      int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+      if (ret != 0) {
+        warning(ret, "unable to prefetch file: %s", path.c_str());
+        return;
+      }
+    }
+    prefetched += size;
+    current.files++;
+    current.pages += (size + page_size - 1) / page_size;
+    logmsg(LOG_DEBUG, "prefetched file: %s", path.c_str());
+  }
+
+  // Handle the file or directory open at fd, which is closed.
+  void visit(int fd, const string &path) {
+    struct stat s;
+    if (fstat(fd, &s) != 0) {
+      warning(errno, "unable to stat: %s", path.c_str());
+      close(fd);
+      return;
+    }
+    if (!seen.emplace(s.st_dev, s.st_ino).second) {
+      close(fd);
+      return;
+    }
+
+    if (S_ISDIR(s.st_mode)) {
+      visit_directory(fd, path);
+      return;
+    }
+    if (S_ISREG(s.st_mode) && s.st_size > 0) {
+      if (args.report) {
+        report_file(fd, s.st_size, path);
+      } else {
+        prefetch_file(fd, s.st_size, path);
+      }
+    }
+    close(fd);
+  }
+
+  // Visit all entries of the directory open at dirfd, which is closed.
+  void visit_directory(int dirfd, const string &path) {
+    DIR *dir = fdopendir(dirfd);
+    if (dir == nullptr) {
+      warning(errno, "unable to open directory: %s", path.c_str());
+      close(dirfd);
+      return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        continue;
+      }
+      // Only files and directories have pages; skip other types without
+      // opening them, in particular FIFOs which would block.
+      unsigned char type = entry->d_type;
+      if (type == DT_LNK && args.no_dereference) {
+        continue;
+      }
+      if (type != DT_REG && type != DT_DIR && type != DT_LNK &&
+          type != DT_UNKNOWN) {
+        continue;
+      }
+
+      string entry_path = path + "/" + entry->d_name;
+      int fd = openat(dirfd, entry->d_name,
+                      O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK |
+                          (args.no_dereference ? O_NOFOLLOW : 0));
+      if (fd == -1) {
+        // Dangling and (with -P) other symlinks are common in a chroot.
+        if (args.verbose || (errno != ELOOP && errno != ENOENT)) {
+          warning(errno, "unable to open: %s", entry_path.c_str());
+        }
+        continue;
+      }
+      visit(fd, entry_path);
+    }
+    if (closedir(dir) != 0) {
+      warning(errno, "unable to close directory: %s", path.c_str());
+    }
+  }
+
+  void run(int argc, char **argv) {
+    for (int i = optind; i < argc; i++) {
+      current = residency_t();
+      int fd = open(argv[i], O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+      if (fd == -1) {
+        warning(errno, "unable to open: %s", argv[i]);
+        continue;
+      }
+      visit(fd, argv[i]);
+
+      if (args.report) {
+        printf("%5.1f%% %10zu/%-10zu %s\n",
+               current.pages == 0 ? 100.0 : 100.0 * current.resident / current.pages,
+               current.resident, current.pages, argv[i]);
+      } else {
+        logmsg(LOG_INFO, "prefetched %zu pages in %zu files: %s",
+               current.pages, current.files, argv[i]);
+      }
+    }
+  }
+};
+
+int main(int argc, char **argv) {
+  state_t state(argc, argv);
+  state.run(argc, argv);
+  return 0;
+}
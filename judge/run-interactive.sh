@@ -1,6 +1,6 @@
 #!/bin/sh
 
-# Run wrapper-script to be called from 'testcase_run.sh'.
+# Run wrapper-script to be called from 'judge-runner'.
 #
 # This script is meant to simplify writing interactive problems where the
 # contestants' solution bi-directionally communicates with a jury program, e.g.
@@ -10,16 +10,18 @@
 #
 # <testin>      File containing test-input.
 # <testout>     File containing test-output.
-# <progout>     File where to write solution output. Note: this is unused.
+# <progout>     File where to write the interaction log.
+# <metafile>    File where to write validator metadata.
 # <feedbackdir> Directory to write jury feedback files to.
 # <program>     Command and options of the program to be run.
 
 # A jury-written program called 'runjury' should be available; this program
 # will normally be compiled by the build script in the validator directory.
 # This program should communicate with the contestants' program to provide
-# input and read output via stdin/stdout. This wrapper script handles the setup
-# of bi-directional pipes. The jury program should accept the following calling
-# syntax:
+# input and read output via stdin/stdout. This wrapper script passes it to
+# runguard's interactive mode, which sets up the bi-directional pipes (proxied
+# and logged to <progout>) and runs it outside the sandbox. The jury program
+# should accept the following calling syntax:
 #
 #    runjury <testin> <testout> <feedbackdir> < <output of the program>
 #
@@ -34,6 +36,31 @@ FEEDBACK="$1"; shift
 
 MYDIR="$(dirname $0)"
 
-# Run the program while redirecting its stdin/stdout to 'runjury' via
-# 'runpipe'. Note that "$@" expands to separate, quoted arguments.
-exec ../../dj-bin/runpipe ${DEBUG:+-v} -M "$META" -o "$PROGOUT" "$MYDIR/runjury" "$TESTIN" "$TESTOUT" "$FEEDBACK" = "$@"
+# Run the program under runguard's interactive mode, with its stdin/stdout
+# connected to 'runjury'. The "$@" we get is the full runguard command line
+# ending in '-- <program>...': insert the interactive options before the
+# '--' and the validator command after it. The validator gets the same
+# CPU time budget as compare scripts. When judge-runner gave us one of
+# the judgedaemon's housekeeping CPUs in PROXY_CPU, runguard passes on
+# the interaction from there in low-latency mode. A leading '=' in program arguments must be escaped
+# as '==', since '=' separates both commands.
+FOUND=0
+for ARG in "$@"; do
+	shift
+	if [ "$FOUND" -eq 1 ]; then
+		case "$ARG" in
+			=*) ARG="=$ARG" ;;
+		esac
+		set -- "$@" "$ARG"
+	elif [ "x$ARG" = "x--" ]; then
+		set -- "$@" --interactive --valmeta="$META" --outinteract="$PROGOUT" \
+			${SCRIPTTIMELIMIT:+--valtime="$SCRIPTTIMELIMIT"} \
+			${PROXY_CPU:+--low-latency --proxy-cpu="$PROXY_CPU"} -- \
+			"$MYDIR/runjury" "$TESTIN" "$TESTOUT" "$FEEDBACK" =
+		FOUND=1
+	else
+		set -- "$@" "$ARG"
+	fi
+done
+
+exec "$@"
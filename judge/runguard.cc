@@ -25,6 +25,15 @@
    has passed, followed by a SIGKILL after 'killdelay'. The program is
    considered to have finished when the main program thread exits. At
    that time any children still running are killed.
+
+   In interactive mode a second, unrestricted validator command is
+   started next to the command, with the stdin/stdout of both
+   connected to each other. The traffic is optionally passed through
+   runguard to log it to file. Runguard then only returns when both
+   have exited and reports the exitcode of the validator. For many tiny
+   messages the round trip through runguard is dominated by its
+   wakeups; in low-latency mode it busy-polls for a short, adaptive
+   time before sleeping and only writes the log before sleeping.
  */
 
 #include "config.h"
@@ -40,6 +49,7 @@
 #include <sys/time.h>
 #include <sys/times.h>
 #include <sys/resource.h>
+#include <sys/mount.h>
 #include <sys/types.h>
 #include <cerrno>
 #include <fcntl.h>
@@ -76,6 +86,27 @@
 #define PIPE_OUT 0
 
 #define BUF_SIZE 4*1024
+#define PROXY_BUF_SIZE 64*1024
+
+/* Size of the buffer for the interaction log in low-latency mode. */
+#define INTERACT_BATCH_SIZE 1024*1024
+
+/* Bounds in microseconds of the adaptive busy-poll time in low-latency
+   mode, and where it starts. */
+#define MIN_SPIN_US 5
+#define MAX_SPIN_US 200
+#define START_SPIN_US 50
+
+/* Attempts, 10ms apart, to find a reader for the stdout copy FIFO. */
+#define TEE_OPEN_TRIES 100
+
+/* Buffer size requested for the stdout copy FIFO, so that a reader can
+   lag behind this much before the copy is dropped. */
+#define TEE_PIPE_SIZE 1024*1024
+
+/* Array indices of the command and validator in interactive mode. */
+#define CMD 0
+#define VAL 1
 
 /* Types of time for writing to file. */
 #define WALL_TIME_TYPE 0
@@ -108,8 +139,15 @@ char  *rootchdir;
 char  *stdoutfilename;
 char  *stderrfilename;
 char  *metafilename;
+char  *valname;
+char **valargs;
+char  *interactfilename;
+char  *teefilename;
+char  *valmetafilename;
 std::vector<std::string> environment_variables;
+std::vector<std::string> bind_mounts;
 FILE  *metafile;
+FILE  *valmetafile;
 
 char  cgroupname[255];
 const char *cpuset;
@@ -126,6 +164,7 @@ int rungid;
 int use_root;
 int use_walltime;
 int use_cputime;
+int use_valtime;
 int use_user;
 int use_group;
 int redir_stdout;
@@ -140,11 +179,15 @@ int be_quiet;
 int show_help;
 int show_version;
 int in_error_handling = 0;
+int interactive;
+int low_latency;
+int proxy_cpu = -1;
 pid_t runpipe_pid = -1;
 
 bool is_cgroup_v2 = false;
 
 double walltimelimit[2], cputimelimit[2]; /* in seconds, soft and hard limits */
+double valtimelimit[2];                   /* CPU time budget of the validator */
 int walllimit_reached, cpulimit_reached; /* 1=soft, 2=hard, 3=both limits reached */
 rlim_t memsize;
 rlim_t filesize;
@@ -153,6 +196,9 @@ size_t streamsize;
 int use_splice;
 
 pid_t child_pid = -1;
+pid_t valpid = -1;
+uid_t valuid;
+gid_t valgid;
 
 static volatile sig_atomic_t received_SIGCHLD = 0;
 static volatile sig_atomic_t received_signal = -1;
@@ -161,7 +207,29 @@ static volatile sig_atomic_t error_in_signalhandler = 0;
 int child_pipefd[3][2];
 int child_redirfd[3];
 
-struct timeval progstarttime, starttime, endtime;
+/* Interactive mode: stdin/stdout of the command and validator and, if
+   the interaction is logged, the proxy pipe ends kept by the watchdog:
+   proxy_in[i] reads what process i writes, proxy_out[i] writes to it. */
+int inter_stdin[2]  = { -1, -1 };
+int inter_stdout[2] = { -1, -1 };
+int proxy_in[2]     = { -1, -1 };
+int proxy_out[2]    = { -1, -1 };
+int interactfd = -1;
+size_t proxy_bytes[2];
+char *interact_batch;
+size_t interact_batch_len;
+long spin_us = START_SPIN_US;
+int child_exited, val_exited, val_exited_first;
+int valstatus;
+struct rusage childusage, valusage;
+
+/* Copy of the command stdout written to a FIFO, and whether it is (still)
+   complete. */
+int teefd = -1;
+int tee_ok;
+
+struct timeval progstarttime, starttime, endtime, valendtime;
+pid_t runguard_pid;
 struct tms startticks, endticks;
 
 struct option const long_opts[] = {
@@ -183,6 +251,14 @@ struct option const long_opts[] = {
 	{"variable",   required_argument, nullptr,         'V'},
 	{"outmeta",    required_argument, nullptr,         'M'},
 	{"runpipepid", required_argument, nullptr,         'U'},
+	{"interactive",no_argument,       nullptr,         'I'},
+	{"outinteract",required_argument, nullptr,         'O'},
+	{"valmeta",    required_argument, nullptr,         'W'},
+	{"valtime",    required_argument, nullptr,         'T'},
+	{"low-latency",no_argument,       nullptr,         'l'},
+	{"proxy-cpu",  required_argument, nullptr,         'L'},
+	{"stdout-tee", required_argument, nullptr,         'S'},
+	{"bind",       required_argument, nullptr,         'B'},
 	{"verbose",    no_argument,       nullptr,         'v'},
 	{"quiet",      no_argument,       nullptr,         'q'},
 	{"help",       no_argument,       &show_help,       1 },
@@ -190,6 +266,13 @@ struct option const long_opts[] = {
 	{ nullptr,     0,                 nullptr,          0 }
 };
 
+/* Buffered writing of messages to stderr, from lib.error. Its header
+   is not included, as its error and warning functions differ. */
+extern "C" {
+void logflush(void);
+void logstderr(const char *, size_t, int);
+}
+
 void warning(   const char *, ...) __attribute__((format (printf, 1, 2)));
 void verbose(   const char *, ...) __attribute__((format (printf, 1, 2)));
 void error(int, const char *, ...) __attribute__((format (printf, 2, 3)));
@@ -201,9 +284,12 @@ void warning(const char *format, ...)
 	va_start(ap,format);
 
 	if ( ! be_quiet ) {
-		fprintf(stderr,"%s: warning: ",progname);
-		vfprintf(stderr,format,ap);
-		fprintf(stderr,"\n");
+		char msg[4096];
+		int len = snprintf(msg,sizeof(msg),"%s: warning: ",progname);
+		len += vsnprintf(msg+len,sizeof(msg)-len,format,ap);
+		if ( len>(int)sizeof(msg)-2 ) len = sizeof(msg)-2;
+		msg[len++] = '\n';
+		logstderr(msg,len,1);
 	}
 
 	va_end(ap);
@@ -219,9 +305,14 @@ void verbose(const char *format, ...)
 		gettimeofday(&currtime,nullptr);
 		double runtime = (currtime.tv_sec  - progstarttime.tv_sec ) +
 		                 (currtime.tv_usec - progstarttime.tv_usec)*1E-6;
-		fprintf(stderr,"%s [%d @ %10.6lf]: verbose: ",progname,getpid(),runtime);
-		vfprintf(stderr,format,ap);
-		fprintf(stderr,"\n");
+		char msg[4096];
+		int len = snprintf(msg,sizeof(msg),"%s [%d @ %10.6lf]: verbose: ",progname,getpid(),runtime);
+		len += vsnprintf(msg+len,sizeof(msg)-len,format,ap);
+		if ( len>(int)sizeof(msg)-2 ) len = sizeof(msg)-2;
+		msg[len++] = '\n';
+		/* Buffer the messages of the watchdog, but not those of forked
+		   children: these change their stderr and exec. */
+		logstderr(msg,len,getpid()!=runguard_pid);
 	}
 
 	va_end(ap);
@@ -298,6 +389,7 @@ void error(int errnum, const char *format, ...)
 		snprintf(errstr+errpos,errlen-errpos,": unknown error");
 	}
 
+	logflush();
 	fprintf(stderr,"%s\nTry `%s --help' for more information.\n",errstr,progname);
 	va_end(ap);
 
@@ -315,7 +407,7 @@ void error(int errnum, const char *format, ...)
 			/*
 			 * continue, there is not much we can do here.
 			 * In the worst case, this will trigger an error
-			 * in testcase_run.sh, as the runuser may still be
+			 * in judge-runner, as the runuser may still be
 			 * running processes
 			 */
 		}
@@ -365,8 +457,9 @@ void usage()
 {
 	printf("\
 Usage: %s [OPTION]... COMMAND...\n\
+   or: %s [OPTION]... --interactive VALIDATOR... = COMMAND...\n\
 Run COMMAND with restrictions.\n\
-\n", progname);
+\n", progname, progname);
 	printf("\
   -r, --root=ROOT        run COMMAND with root directory set to ROOT\n\
   -u, --user=USER        run COMMAND as user with username or ID USER\n\
@@ -389,7 +482,18 @@ Run COMMAND with restrictions.\n\
                            multiple times\n\
   -M, --outmeta=FILE     write metadata (runtime, exitcode, etc.) to FILE\n\
   -U, --runpipepid=PID   process ID of runpipe to send SIGUSR1 signal when\n\
-                           timelimit is reached\n");
+                           timelimit is reached\n\
+  -I, --interactive      run VALIDATOR unrestricted with its stdin/stdout\n\
+                           bi-directionally connected to COMMAND\n\
+  -O, --outinteract=FILE pass interaction through runguard and log it to FILE\n\
+  -W, --valmeta=FILE     write metadata of VALIDATOR to FILE\n\
+  -T, --valtime=TIME     kill VALIDATOR after TIME seconds CPU time\n\
+  -l, --low-latency      minimize the latency of passing on the interaction,\n\
+                           at the cost of busy-polling for short periods\n\
+  -L, --proxy-cpu=ID     pass on the interaction from processor number ID\n\
+  -S, --stdout-tee=FIFO  also write COMMAND stdout, as passed on, to FIFO\n\
+  -B, --bind=DIR:TARGET  bind mount DIR read-only at TARGET within ROOT;\n\
+                           may be passed multiple times\n");
 	printf("\
   -v, --verbose          display some extra warnings and information\n\
   -q, --quiet            suppress all warnings and verbose output\n\
@@ -404,7 +508,16 @@ TIME may be specified as a float; two floats separated by `:' are treated\n\
 as soft and hard limits. The runtime written to file is that of the last\n\
 of wall/cpu time options set, and defaults to CPU time when neither is set.\n\
 When run setuid without the `user' option, the user ID is set to the\n\
-real user ID.\n");
+real user ID.\n\
+In interactive mode VALIDATOR runs as the invoking (sudo) user and its\n\
+exitcode is returned; arguments starting with a `=' must be escaped by\n\
+prepending an extra `='. Without `outinteract' the streams are connected\n\
+directly and the stdout `streamsize' limit does not apply.\n\
+The `stdout-tee' FIFO must already have a reader; without one runguard\n\
+warns and runs without the copy. A reader that cannot keep up loses the\n\
+copy, which is then not reported complete in the metadata.\n\
+The `bind' mounts are private to COMMAND and removed when it exits; DIR\n\
+must be within the same prescribed path as ROOT.\n");
 	exit(0);
 }
 
@@ -424,6 +537,12 @@ void output_exit_time(int exitcode, double cpudiff)
 	double userdiff = (double)(endticks.tms_cutime - startticks.tms_cutime) / ticks_per_second;
 	double sysdiff  = (double)(endticks.tms_cstime - startticks.tms_cstime) / ticks_per_second;
 
+	/* The validator is also our child, so only count the command. */
+	if ( interactive ) {
+		userdiff = childusage.ru_utime.tv_sec + childusage.ru_utime.tv_usec*1E-6;
+		sysdiff  = childusage.ru_stime.tv_sec + childusage.ru_stime.tv_usec*1E-6;
+	}
+
 	write_meta("wall-time","%.3f", walldiff);
 	write_meta("user-time","%.3f", userdiff);
 	write_meta("sys-time", "%.3f", sysdiff);
@@ -713,6 +832,8 @@ void terminate(int sig)
 		warning_from_signalhandler("timelimit exceeded (hard wall time): aborting command");
 	} else {
 		warning_from_signalhandler("received signal: aborting command");
+		/* The validator is not part of the command's process group. */
+		if ( valpid>0 ) kill(valpid,SIGTERM);
 	}
 
 	received_signal = sig;
@@ -817,6 +938,39 @@ void read_optarg_time(const char *desc, double *times)
 	free(optcopy);
 }
 
+/* Bind mount a directory read-only within the root directory, for a
+   `DIR:TARGET' bind option. This is done in our own mount namespace, so
+   the mount is gone when runguard exits. Must be called with the root
+   directory as working directory. */
+void bind_mount(const std::string &spec, const char *root, const char *prefix)
+{
+	size_t sep = spec.find(':');
+	std::string src = spec.substr(0,sep);
+	std::string target = "./" + spec.substr(sep+1);
+	char srcpath[PATH_MAX+1], targetpath[PATH_MAX+2];
+
+	if ( realpath(src.c_str(),srcpath)==nullptr ) {
+		error(errno,"cannot canonicalize path '%s'",src.c_str());
+	}
+	if ( strncmp(srcpath,prefix,strlen(prefix))!=0 ) {
+		error(0,"invalid bind source: must be within `%s'",prefix);
+	}
+	if ( realpath(target.c_str(),targetpath)==nullptr ) {
+		error(errno,"cannot canonicalize path '%s'",target.c_str());
+	}
+	strcat(targetpath,"/");
+	if ( strncmp(targetpath,root,strlen(root))!=0 ) {
+		error(0,"invalid bind target: must be within `%s'",root);
+	}
+
+	if ( mount(srcpath,targetpath,nullptr,MS_BIND,nullptr)!=0 ||
+	     mount(nullptr,targetpath,nullptr,
+	           MS_BIND|MS_REMOUNT|MS_RDONLY|MS_NOSUID|MS_NODEV,nullptr)!=0 ) {
+		error(errno,"cannot bind mount `%s' at `%s'",srcpath,targetpath);
+	}
+	verbose("bind mounted `%s' read-only at `%s'",srcpath,targetpath);
+}
+
 void setrestrictions()
 {
 	/* Clear environment to prevent all kinds of security holes, save PATH */
@@ -936,6 +1090,14 @@ void setrestrictions()
 		if ( strncmp(cwd,path,strlen(path))!=0 ) {
 			error(0,"invalid root: must be within `%s'",path);
 		}
+
+		if ( !bind_mounts.empty() ) {
+			/* Do not propagate the bind mounts out of our namespace. */
+			if ( mount(nullptr,"/",nullptr,MS_REC|MS_PRIVATE,nullptr)!=0 ) {
+				error(errno,"cannot make mounts private");
+			}
+			for(const auto &spec : bind_mounts) bind_mount(spec,cwd,path);
+		}
 		free(path);
 
 		if ( chroot(".")!=0 ) error(errno,"cannot change root to `%s'",cwd);
@@ -971,6 +1133,77 @@ void setrestrictions()
 	}
 }
 
+/* Write all data to a file descriptor, returns 0 on success. */
+int write_all(int fd, const char *buf, size_t len)
+{
+	while ( len>0 ) {
+		ssize_t nwritten = write(fd, buf, len);
+		if ( nwritten==-1 ) {
+			if ( errno==EINTR ) continue;
+			return -1;
+		}
+		buf += nwritten;
+		len -= nwritten;
+	}
+	return 0;
+}
+
+/* Open the FIFO that a copy of the command stdout is written to. Its
+   reader should be waiting already, so give up after a short while if
+   there is none and run without the copy. */
+void open_tee()
+{
+	struct stat st;
+
+	for(int tries=0; ; tries++) {
+		teefd = open(teefilename, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if ( teefd>=0 || errno!=ENXIO || tries>=TEE_OPEN_TRIES ) break;
+		usleep(10000);
+	}
+	if ( teefd<0 ) {
+		warning("not copying stdout, cannot open `%s': %s",
+		        teefilename, strerror(errno));
+		return;
+	}
+	if ( fstat(teefd,&st)!=0 ) error(errno,"cannot stat `%s'",teefilename);
+	if ( !S_ISFIFO(st.st_mode) ) error(0,"`%s' is not a FIFO",teefilename);
+
+	/* The FIFO stays non-blocking: a slow reader must not throttle the
+	   command, nor keep us from handling its time limit. */
+	if ( fcntl(teefd, F_SETPIPE_SZ, TEE_PIPE_SIZE)==-1 ) {
+		verbose("cannot resize `%s': %s",teefilename,strerror(errno));
+	}
+	tee_ok = 1;
+}
+
+/* Write a copy of command stdout to the tee FIFO. A reader that closes
+   it has seen all it needs. If the reader cannot keep up, or on other
+   errors, the copy is dropped and marked incomplete, so the output is
+   compared after the run instead. */
+void write_tee(const char *buf, size_t len)
+{
+	ssize_t nwritten;
+
+	if ( teefd<0 ) return;
+	while ( len>0 && (nwritten = write(teefd, buf, len))>=0 ) {
+		buf += nwritten;
+		len -= nwritten;
+	}
+	if ( len==0 ) return;
+
+	if ( errno==EPIPE ) {
+		verbose("reader closed `%s'",teefilename);
+	} else if ( errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR ) {
+		verbose("reader of `%s' lags behind, dropping the copy",teefilename);
+		tee_ok = 0;
+	} else {
+		warning("writing to `%s': %s",teefilename,strerror(errno));
+		tee_ok = 0;
+	}
+	close(teefd);
+	teefd = -1;
+}
+
 void pump_pipes(fd_set* readfds, size_t data_read[], size_t data_passed[])
 {
 	char buf[BUF_SIZE];
@@ -993,7 +1226,8 @@ void pump_pipes(fd_set* readfds, size_t data_read[], size_t data_passed[])
 					to_read = min(BUF_SIZE, streamsize-data_passed[i]);
 				}
 
-				if ( use_splice ) {
+				/* The stdout copy needs the data in userspace. */
+				if ( use_splice && !(i==STDOUT_FILENO && teefd>=0) ) {
 					nread = splice(child_pipefd[i][PIPE_OUT], nullptr,
 					               child_redirfd[i], nullptr,
 					               to_read, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
@@ -1022,6 +1256,7 @@ void pump_pipes(fd_set* readfds, size_t data_read[], size_t data_passed[])
 							}
 							to_write -= nwritten;
 						}
+						if ( nread>0 && i==STDOUT_FILENO ) write_tee(buf, nread);
 					}
 				}
 
@@ -1050,6 +1285,369 @@ void pump_pipes(fd_set* readfds, size_t data_read[], size_t data_passed[])
 
 }
 
+/* Disarm the wall-time timer, so that any slow clean-up steps (or a
+   validator still running) are not mistaken for a wall-time timeout. */
+void disarm_timer()
+{
+	struct itimerval itimer;
+
+	if ( !use_walltime ) return;
+
+	itimer.it_interval.tv_sec  = 0;
+	itimer.it_interval.tv_usec = 0;
+	itimer.it_value.tv_sec  = 0;
+	itimer.it_value.tv_usec = 0;
+
+	if ( setitimer(ITIMER_REAL,&itimer,nullptr)!=0 ) {
+		error(errno,"disarming timer");
+	}
+}
+
+/* Set up the pipes connecting command and validator in interactive
+   mode. Without interaction log these directly connect stdout of one
+   to stdin of the other, otherwise each direction gets two pipes with
+   the watchdog proxying in between. */
+void setup_interaction()
+{
+	int fds[2];
+
+	for(int i=0; i<2; i++) {
+		if ( pipe2(fds,O_CLOEXEC)!=0 ) error(errno,"creating interaction pipe");
+		inter_stdout[i] = fds[PIPE_IN];
+		if ( interactfilename==nullptr ) {
+			inter_stdin[1-i] = fds[PIPE_OUT];
+			continue;
+		}
+		proxy_in[i] = fds[PIPE_OUT];
+		int flags = fcntl(proxy_in[i], F_GETFL);
+		if ( flags==-1 || fcntl(proxy_in[i], F_SETFL, flags | O_NONBLOCK)==-1 ) {
+			error(errno,"setting interaction pipe non-blocking");
+		}
+
+		if ( pipe2(fds,O_CLOEXEC)!=0 ) error(errno,"creating interaction pipe");
+		proxy_out[1-i] = fds[PIPE_IN];
+		inter_stdin[1-i] = fds[PIPE_OUT];
+	}
+
+	if ( interactfilename!=nullptr ) {
+		interactfd = open(interactfilename, O_CREAT | O_CLOEXEC | O_WRONLY | O_TRUNC,
+		                  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+		if ( interactfd<0 ) error(errno,"opening file '%s'",interactfilename);
+		if ( low_latency ) {
+			interact_batch = (char *) malloc(INTERACT_BATCH_SIZE);
+			if ( interact_batch==nullptr ) error(errno,"allocating memory");
+		}
+	}
+}
+
+/* Close the interaction file descriptors that are passed on to the
+   command and validator; called in the watchdog after forking both. */
+void close_interaction_child_fds()
+{
+	for(int i=0; i<2; i++) {
+		if ( close(inter_stdin[i])!=0 || close(inter_stdout[i])!=0 ) {
+			error(errno,"closing interaction pipes");
+		}
+		inter_stdin[i] = inter_stdout[i] = -1;
+	}
+}
+
+void spawn_validator()
+{
+	switch ( valpid = fork() ) {
+	case -1: /* error */
+		error(errno,"cannot fork validator");
+	case  0: /* run validator */
+		/* The validator runs without restrictions, outside the chroot
+		   and cgroup, as the (unprivileged) user invoking runguard.
+		   Make sure it does not keep the command stdout/stderr open. */
+		for(int i=1; i<=2; i++) {
+			if ( close(child_pipefd[i][PIPE_IN] )!=0 ||
+			     close(child_pipefd[i][PIPE_OUT])!=0 ) {
+				error(errno,"closing pipe for fd %d",i);
+			}
+		}
+		if ( outputmeta ) {
+			outputmeta = 0;
+			if ( fclose(metafile)!=0 ) error(errno,"closing file `%s'",metafilename);
+		}
+		if ( valmetafile!=nullptr ) fclose(valmetafile);
+
+		sigset_t emptymask;
+		if ( sigemptyset(&emptymask)!=0 ||
+		     sigprocmask(SIG_SETMASK, &emptymask, nullptr)!=0 ) {
+			error(errno,"unmasking signals");
+		}
+
+		if ( dup2(inter_stdin[VAL], STDIN_FILENO)<0 ||
+		     dup2(inter_stdout[VAL],STDOUT_FILENO)<0 ) {
+			error(errno,"redirecting validator stdin/stdout");
+		}
+
+		/* Enforce the validator time budget in the same way as the
+		   CPU-time limit of the command, see setrestrictions(). */
+		if ( use_valtime ) {
+			struct rlimit lim;
+			lim.rlim_cur = (rlim_t)ceil(valtimelimit[1]);
+			lim.rlim_max = lim.rlim_cur+1;
+			if ( setrlimit(RLIMIT_CPU,&lim)!=0 ) error(errno,"setting validator CPU-time limit");
+		}
+
+		if ( setgid(valgid) ) error(errno,"cannot set validator group ID to `%d'",valgid);
+		if ( setgroups(0, NULL) ) error(errno,"cannot clear auxiliary groups");
+		if ( setuid(valuid) ) error(errno,"cannot set validator user ID to `%d'",valuid);
+
+		execvp(valname,valargs);
+		error(errno,"cannot start validator `%s'",valname);
+
+	default: /* watchdog */
+		verbose("validator pid = %d", valpid);
+	}
+}
+
+/* Write the batched interaction log to file, if any. */
+void flush_interaction()
+{
+	if ( interact_batch_len==0 ) return;
+	if ( write_all(interactfd, interact_batch, interact_batch_len)!=0 ) {
+		error(errno,"writing to file '%s'",interactfilename);
+	}
+	interact_batch_len = 0;
+}
+
+/* Write data to the interaction log, or in low-latency mode append it
+   to the batch that is written before sleeping. */
+void emit_interaction(const char *buf, size_t len)
+{
+	if ( interact_batch!=nullptr && len<=INTERACT_BATCH_SIZE ) {
+		if ( interact_batch_len+len>INTERACT_BATCH_SIZE ) flush_interaction();
+		memcpy(interact_batch+interact_batch_len, buf, len);
+		interact_batch_len += len;
+		return;
+	}
+	flush_interaction();
+	if ( write_all(interactfd, buf, len)!=0 ) {
+		error(errno,"writing to file '%s'",interactfilename);
+	}
+}
+
+/* Write a message to the interaction log, using the same format as
+   runpipe: [time/bytes]direction: content, where direction is `>' for
+   validator output and `<' for command output. EOF is logged as `]'
+   or `[' respectively, without content. */
+void write_interaction(int from, const char *buf, size_t len, bool eof)
+{
+	struct timeval currtime;
+	char header[64];
+
+	gettimeofday(&currtime,nullptr);
+	long millis = (currtime.tv_sec  - starttime.tv_sec )*1000 +
+	              (currtime.tv_usec - starttime.tv_usec)/1000;
+
+	char direction = from==VAL ? (eof ? ']' : '>') : (eof ? '[' : '<');
+	int header_len = snprintf(header, sizeof(header), "[%3ld.%03lds/%zu]%c%s",
+	                          millis/1000, millis%1000, len, direction, eof ? "" : ": ");
+
+	emit_interaction(header, header_len);
+	if ( !eof ) {
+		emit_interaction(buf, len);
+		emit_interaction("\n", 1);
+	}
+}
+
+/* Pass on all data available from the command or validator to the
+   other side, and log it. Data from the command beyond the stream
+   size limit is read but discarded. */
+void pump_interaction(fd_set* readfds, size_t data_read[], size_t data_passed[])
+{
+	static char buf[PROXY_BUF_SIZE];
+
+	for(int i=0; i<2; i++) {
+		if ( proxy_in[i]<0 || !FD_ISSET(proxy_in[i], readfds) ) continue;
+
+		while ( true ) {
+			ssize_t nread = read(proxy_in[i], buf, PROXY_BUF_SIZE);
+			if ( nread<0 ) {
+				if ( errno==EINTR ) continue;
+				if ( errno==EAGAIN || errno==EWOULDBLOCK ) break;
+				error(errno,"reading interaction from %s", i==CMD ? "command" : "validator");
+			}
+			if ( nread==0 ) {
+				/* EOF: signal this to the other side as well. */
+				verbose("EOF from %s", i==CMD ? "command" : "validator");
+				write_interaction(i, buf, 0, true);
+				if ( close(proxy_in[i])!=0 ) error(errno,"closing interaction pipe");
+				proxy_in[i] = -1;
+				if ( proxy_out[1-i]>=0 && close(proxy_out[1-i])!=0 ) {
+					error(errno,"closing interaction pipe");
+				}
+				proxy_out[1-i] = -1;
+				break;
+			}
+
+			size_t npass = nread;
+			if ( i==CMD ) {
+				data_read[STDOUT_FILENO] += nread;
+				if ( limit_streamsize ) {
+					npass = min(npass, streamsize-data_passed[STDOUT_FILENO]);
+				}
+				data_passed[STDOUT_FILENO] += npass;
+			}
+			if ( npass==0 ) continue;
+
+			write_interaction(i, buf, npass, false);
+			proxy_bytes[i] += npass;
+
+			/* When the other side has closed its input, stop reading
+			   from this side too, as if they were directly connected. */
+			if ( proxy_out[1-i]>=0 && write_all(proxy_out[1-i], buf, npass)!=0 ) {
+				if ( errno!=EPIPE ) error(errno,"writing interaction to %s",
+				                          i==CMD ? "validator" : "command");
+				verbose("%s closed its input", i==CMD ? "validator" : "command");
+				if ( close(proxy_out[1-i])!=0 || close(proxy_in[i])!=0 ) {
+					error(errno,"closing interaction pipe");
+				}
+				proxy_out[1-i] = proxy_in[i] = -1;
+				break;
+			}
+
+			/* Signal truncated command output to the validator as EOF. */
+			if ( i==CMD && limit_streamsize && proxy_out[VAL]>=0 &&
+			     data_passed[STDOUT_FILENO]>=streamsize ) {
+				verbose("stream size limit reached, closing validator input");
+				if ( close(proxy_out[VAL])!=0 ) error(errno,"closing interaction pipe");
+				proxy_out[VAL] = -1;
+			}
+		}
+	}
+}
+
+/* Wait for data from the command or validator, or a signal, like
+   pselect() without timeout. In low-latency mode first poll for at
+   most spin_us without sleeping, doubling it when data arrives in time
+   and halving it otherwise. The interaction log and buffered messages
+   are written out before going to sleep. */
+int wait_for_data(int nfds, fd_set *readfds, const sigset_t *sigmask)
+{
+	if ( low_latency ) {
+		const struct timespec nowait = { 0, 0 };
+		struct timespec now, deadline;
+		fd_set polled;
+
+		if ( clock_gettime(CLOCK_MONOTONIC,&deadline)!=0 ) error(errno,"getting time");
+		deadline.tv_nsec += spin_us*1000;
+		if ( deadline.tv_nsec>=1000000000L ) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		do {
+			polled = *readfds;
+			int r = pselect(nfds, &polled, nullptr, nullptr, &nowait, sigmask);
+			if ( r!=0 ) {
+				if ( r>0 ) spin_us = min(2*spin_us, MAX_SPIN_US);
+				*readfds = polled;
+				return r;
+			}
+			if ( clock_gettime(CLOCK_MONOTONIC,&now)!=0 ) error(errno,"getting time");
+		} while ( now.tv_sec<deadline.tv_sec ||
+		          (now.tv_sec==deadline.tv_sec && now.tv_nsec<deadline.tv_nsec) );
+		spin_us = max(spin_us/2, MIN_SPIN_US);
+	}
+
+	flush_interaction();
+	logflush();
+	return pselect(nfds, readfds, nullptr, nullptr, nullptr, sigmask);
+}
+
+/* Reap exited command and validator without blocking. Returns true
+   when both have exited. */
+bool reap_children(int *status)
+{
+	pid_t pid;
+	int tmpstatus;
+	struct rusage usage;
+
+	received_SIGCHLD = 0;
+	while ( (pid = wait4(-1, &tmpstatus, WNOHANG, &usage))>0 ) {
+		if ( pid==child_pid ) {
+			verbose("command exited");
+			child_exited = 1;
+			*status = tmpstatus;
+			childusage = usage;
+			if ( gettimeofday(&endtime,nullptr) ) error(errno,"getting time");
+			disarm_timer();
+		} else if ( pid==valpid ) {
+			verbose("validator exited");
+			val_exited = 1;
+			valstatus = tmpstatus;
+			valusage = usage;
+			if ( gettimeofday(&valendtime,nullptr) ) error(errno,"getting time");
+			/* A hard time limit of the command takes precedence. */
+			if ( !child_exited && !(walllimit_reached & hard_timelimit) ) {
+				val_exited_first = 1;
+			}
+		}
+	}
+	if ( pid<0 && errno!=ECHILD ) error(errno,"waiting on children");
+
+	return child_exited && val_exited;
+}
+
+/* Write the validator metadata in the format runpipe also uses and
+   return the validator exitcode. */
+int output_validator_meta()
+{
+	int exitcode = -1;
+
+	if ( WIFEXITED(valstatus) ) {
+		exitcode = WEXITSTATUS(valstatus);
+	} else if ( WIFSIGNALED(valstatus) ) {
+		warning("validator terminated with signal %d",WTERMSIG(valstatus));
+		exitcode = 128+WTERMSIG(valstatus);
+	} else {
+		error(0,"validator exit status unknown: %d",valstatus);
+	}
+	verbose("validator exited with exitcode %d",exitcode);
+
+	if ( valmetafile==nullptr ) return exitcode;
+
+	double walldiff = (valendtime.tv_sec  - starttime.tv_sec ) +
+	                  (valendtime.tv_usec - starttime.tv_usec)*1E-6;
+	double totaldiff = max(walldiff, (endtime.tv_sec  - starttime.tv_sec ) +
+	                                 (endtime.tv_usec - starttime.tv_usec)*1E-6);
+	double userdiff = valusage.ru_utime.tv_sec + valusage.ru_utime.tv_usec*1E-6;
+	double sysdiff  = valusage.ru_stime.tv_sec + valusage.ru_stime.tv_usec*1E-6;
+
+	/* Report an exceeded validator budget separately from time-result,
+	   so it is not mistaken for a timelimit of the command. */
+	if ( use_valtime && userdiff+sysdiff > valtimelimit[0] ) {
+		warning("validator timelimit exceeded: %.3f seconds",userdiff+sysdiff);
+		if ( fprintf(valmetafile,"validator-time-result: timelimit\n")<0 ) {
+			error(errno,"writing to file `%s'",valmetafilename);
+		}
+	}
+
+	if ( fprintf(valmetafile,
+	             "exitcode: %d\n"
+	             "bytes-transferred: %zu\n"
+	             "total-duration-us: %lld\n"
+	             "validator-exited-first: %s\n"
+	             "wall-time: %.3f\n"
+	             "user-time: %.3f\n"
+	             "sys-time: %.3f\n"
+	             "cpu-time: %.3f\n",
+	             exitcode, proxy_bytes[CMD] + proxy_bytes[VAL],
+	             (long long)(totaldiff*1E6), val_exited_first ? "true" : "false",
+	             walldiff, userdiff, sysdiff, userdiff + sysdiff)<0 ||
+	     fclose(valmetafile)!=0 ) {
+		valmetafile = nullptr;
+		error(errno,"writing to file `%s'",valmetafilename);
+	}
+	valmetafile = nullptr;
+
+	return exitcode;
+}
+
 bool cgroup_is_v2() {
 	bool ret = false;
 	FILE *fp = setmntent("/proc/mounts", "r");
@@ -1088,6 +1686,7 @@ int main(int argc, char **argv)
 	struct sigaction sigact;
 
 	progname = argv[0];
+	runguard_pid = getpid();
 
 	if ( gettimeofday(&progstarttime,nullptr) ) error(errno,"getting time");
 
@@ -1102,7 +1701,7 @@ int main(int argc, char **argv)
 	show_help = show_version = 0;
 	opterr = 0;
 	char *ptr;
-	while ( (opt = getopt_long(argc,argv,"+r:u:g:d:t:C:m:f:p:P:co:e:s:EV:M:vqU:",long_opts,(int *) 0))!=-1 ) {
+	while ( (opt = getopt_long(argc,argv,"+r:u:g:d:t:C:m:f:p:P:co:e:s:EV:M:vqU:IO:W:T:lL:S:B:",long_opts,(int *) 0))!=-1 ) {
 		switch ( opt ) {
 		case 0:   /* long-only option */
 			break;
@@ -1217,6 +1816,34 @@ int main(int argc, char **argv)
 		case 'U':
 			runpipe_pid = strtol(optarg, &ptr, 10);
 			break;
+		case 'I': /* interactive option */
+			interactive = 1;
+			break;
+		case 'O': /* outinteract option */
+			interactfilename = strdup(optarg);
+			break;
+		case 'W': /* valmeta option */
+			valmetafilename = strdup(optarg);
+			break;
+		case 'T': /* validator time option */
+			use_valtime = 1;
+			read_optarg_time("validator time",valtimelimit);
+			break;
+		case 'l': /* low-latency option */
+			low_latency = 1;
+			break;
+		case 'L': /* proxy-cpu option */
+			proxy_cpu = (int) read_optarg_int("proxy processor",0,CPU_SETSIZE-1);
+			break;
+		case 'S': /* stdout-tee option */
+			teefilename = strdup(optarg);
+			break;
+		case 'B': /* bind option */
+			if ( strchr(optarg,':')==nullptr ) {
+				error(0,"invalid bind mount specified: `%s'",optarg);
+			}
+			bind_mounts.push_back(std::string(optarg));
+			break;
 		case ':': /* getopt error */
 		case '?':
 			error(0,"unknown option or missing argument `%c'",optopt);
@@ -1247,11 +1874,62 @@ int main(int argc, char **argv)
 	cmdname = argv[optind];
 	cmdargs = argv+optind;
 
+	if ( interactive ) {
+		/* Split 'VALIDATOR... = COMMAND...' and unescape '==' to '='. */
+		int sep = -1;
+		for(int i=optind; i<argc; i++) {
+			if ( sep<0 && strcmp(argv[i],"=")==0 ) {
+				sep = i;
+				argv[i] = nullptr;
+			} else if ( strncmp(argv[i],"==",2)==0 ) {
+				argv[i]++;
+			}
+		}
+		if ( sep<0 || sep==optind || sep+1>=argc ) {
+			error(0,"interactive mode requires `VALIDATOR... = COMMAND...'");
+		}
+		valname = argv[optind];
+		valargs = argv+optind;
+		cmdname = argv[sep+1];
+		cmdargs = argv+sep+1;
+
+		/* Never run the validator with root privileges: when invoked
+		   via sudo, use the original user. */
+		valuid = getuid();
+		valgid = getgid();
+		if ( valuid==0 ) {
+			char *sudo_uid = getenv("SUDO_UID");
+			char *sudo_gid = getenv("SUDO_GID");
+			if ( sudo_uid!=nullptr && sudo_gid!=nullptr ) {
+				valuid = strtol(sudo_uid,&ptr,10);
+				valgid = strtol(sudo_gid,&ptr,10);
+			}
+		}
+		if ( valuid==0 || valgid==0 ) {
+			error(0,"cannot determine unprivileged user to run validator");
+		}
+	} else if ( interactfilename!=nullptr || valmetafilename!=nullptr || use_valtime ) {
+		error(0,"options `outinteract', `valmeta' and `valtime' require interactive mode");
+	}
+	if ( (low_latency || proxy_cpu>=0) && interactfilename==nullptr ) {
+		error(0,"options `low-latency' and `proxy-cpu' require `outinteract'");
+	}
+	if ( interactive && teefilename!=nullptr ) {
+		error(0,"option `stdout-tee' cannot be used in interactive mode");
+	}
+	if ( !bind_mounts.empty() && !use_root ) {
+		error(0,"option `bind' requires option `root'");
+	}
+
 	is_cgroup_v2 = cgroup_is_v2();
 
 	if ( outputmeta && (metafile = fopen(metafilename,"w"))==nullptr ) {
 		error(errno,"cannot open `%s'",metafilename);
 	}
+	if ( valmetafilename!=nullptr && (valmetafile = fopen(valmetafilename,"w"))==nullptr ) {
+		error(errno,"cannot open `%s'",valmetafilename);
+	}
+	if ( teefilename!=nullptr ) open_tee();
 
 	/* Check that new uid is in list of valid uid's. When the new user
 	   was given as a username string, then '*' matches an arbitrary
@@ -1352,6 +2030,11 @@ int main(int argc, char **argv)
 		if ( fclose(fp)!=0 ) error(errno,"closing file `%s'",oom_path);
 	}
 
+	if ( interactive ) {
+		setup_interaction();
+		spawn_validator();
+	}
+
 	switch ( child_pid = fork() ) {
 	case -1: /* error */
 		error(errno,"cannot fork");
@@ -1372,6 +2055,14 @@ int main(int argc, char **argv)
 				error(errno,"closing pipe for fd %d",i);
 			}
 		}
+		/* In interactive mode, the validator replaces stdin/stdout;
+		   the remaining interaction pipes are closed on exec. */
+		if ( interactive ) {
+			if ( dup2(inter_stdin[CMD], STDIN_FILENO)<0 ||
+			     dup2(inter_stdout[CMD],STDOUT_FILENO)<0 ) {
+				error(errno,"redirecting interaction stdin/stdout");
+			}
+		}
 		verbose("pipes closed in child");
 
 		if ( outputmeta ) {
@@ -1380,6 +2071,11 @@ int main(int argc, char **argv)
 			}
 			verbose("metafile closed in child");
 		}
+		if ( valmetafile!=nullptr ) {
+			if ( fclose(valmetafile)!=0 ) {
+				error(errno,"closing file `%s'",valmetafilename);
+			}
+		}
 
 		/* And execute child command. */
 		execvp(cmdname,cmdargs);
@@ -1389,6 +2085,16 @@ int main(int argc, char **argv)
 
 	default: /* become watchdog */
 		verbose("child pid = %d", child_pid);
+		/* Only now that the command and validator have been started,
+		   move to the CPU to pass on the interaction from. */
+		if ( proxy_cpu>=0 ) {
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(proxy_cpu,&cpus);
+			if ( sched_setaffinity(0,sizeof(cpus),&cpus)!=0 ) {
+				warning("cannot pin to processor %d: %s",proxy_cpu,strerror(errno));
+			}
+		}
 		/* Shed privileges, only if not using a separate child uid,
 		   because in that case we may need root privileges to kill
 		   the child process. Do not use Linux specific setresuid()
@@ -1406,6 +2112,18 @@ int main(int argc, char **argv)
 				error(errno,"closing pipe for fd %i",i);
 			}
 		}
+		if ( interactive ) {
+			close_interaction_child_fds();
+			/* Command stdout is connected to the validator instead. */
+			if ( close(child_pipefd[STDOUT_FILENO][PIPE_OUT])!=0 ) {
+				error(errno,"closing pipe for fd %i",STDOUT_FILENO);
+			}
+			child_pipefd[STDOUT_FILENO][PIPE_OUT] = -1;
+			/* Either side may close its end while we proxy. */
+			signal(SIGPIPE, SIG_IGN);
+		}
+		/* The reader of the stdout copy may stop early. */
+		if ( teefd>=0 ) signal(SIGPIPE, SIG_IGN);
 
 		/* Redirect child stdout/stderr to file */
 		for(int i=1; i<=2; i++) {
@@ -1486,13 +2204,29 @@ int main(int argc, char **argv)
 					nfds = max(nfds,child_pipefd[i][PIPE_OUT]);
 				}
 			}
+			for(int i=0; i<2; i++) {
+				if ( proxy_in[i]>=0 ) {
+					FD_SET(proxy_in[i],&readfds);
+					nfds = max(nfds,proxy_in[i]);
+				}
+			}
 
-			int r = pselect(nfds+1, &readfds, nullptr, NULL, NULL, &emptymask);
+			int r = wait_for_data(nfds+1, &readfds, &emptymask);
 			if ( r==-1 && errno!=EINTR ) error(errno,"waiting for child data");
 			if (error_in_signalhandler) {
 				error(errno, "error in signal handler, exiting");
 			}
 
+			if ( interactive ) {
+				/* First pass on data, so that everything written
+				   before an exit reaches the other side. */
+				pump_pipes(&readfds, data_read, data_passed);
+				pump_interaction(&readfds, data_read, data_passed);
+				if ( (received_SIGCHLD || received_signal == SIGALRM) &&
+				     reap_children(&status) ) break;
+				continue;
+			}
+
 			if ( received_SIGCHLD || received_signal == SIGALRM ) {
 				pid_t pid;
 				if ( (pid = wait(&status))<0 ) error(errno,"waiting on child");
@@ -1502,6 +2236,25 @@ int main(int argc, char **argv)
 			pump_pipes(&readfds, data_read, data_passed);
 		}
 
+		/* Log any interaction left unread when both sides exited. */
+		for(int i=0; i<2; i++) {
+			if ( proxy_in[i]>=0 ) {
+				FD_ZERO(&readfds);
+				FD_SET(proxy_in[i],&readfds);
+				pump_interaction(&readfds, data_read, data_passed);
+				if ( proxy_in[i]>=0 && close(proxy_in[i])!=0 ) {
+					error(errno,"closing interaction pipe");
+				}
+			}
+			if ( proxy_out[i]>=0 && close(proxy_out[i])!=0 ) {
+				error(errno,"closing interaction pipe");
+			}
+		}
+		flush_interaction();
+		if ( interactfd>=0 && close(interactfd)!=0 ) {
+			error(errno,"closing file '%s'",interactfilename);
+		}
+
 		/* Reset pipe filedescriptors to use blocking I/O. */
 		FD_ZERO(&readfds);
 		for(int i=1; i<=2; i++) {
@@ -1523,17 +2276,23 @@ int main(int argc, char **argv)
 			pump_pipes(&readfds, data_read, data_passed);
 		} while ( data_passed[1] + data_passed[2] > total_data );
 
-		/* Close the output files */
+		/* Close the output files, which may be our own stdout/stderr. */
+		logflush();
 		for(int i=1; i<=2; i++) {
 			ret = close(child_redirfd[i]);
 			if( ret!=0 ) error(errno,"closing output fd %d", i);
 		}
+		if ( teefd>=0 && close(teefd)!=0 ) {
+			warning("closing `%s': %s",teefilename,strerror(errno));
+			tee_ok = 0;
+		}
 
 		if ( times(&endticks)==(clock_t) -1 ) {
 			error(errno,"getting end clock ticks");
 		}
 
-		if ( gettimeofday(&endtime,nullptr) ) error(errno,"getting time");
+		/* In interactive mode this was recorded when the command exited. */
+		if ( !interactive && gettimeofday(&endtime,nullptr) ) error(errno,"getting time");
 
 		/* Test whether command has finished abnormally */
 		int exitcode = 0;
@@ -1558,19 +2317,10 @@ int main(int argc, char **argv)
 		}
 		verbose("child exited with exit code %d", exitcode);
 
-		if ( use_walltime ) {
-			/* Disarm timer we set previously so if any of the
-			 * clean-up steps below are slow we are not mistaking
-			 * this for a wall-time timeout. */
-			itimer.it_interval.tv_sec  = 0;
-			itimer.it_interval.tv_usec = 0;
-			itimer.it_value.tv_sec  = 0;
-			itimer.it_value.tv_usec = 0;
-
-			if ( setitimer(ITIMER_REAL,&itimer,nullptr)!=0 ) {
-				error(errno,"disarming timer");
-			}
-		}
+		/* Disarm timer we set previously so if any of the clean-up
+		 * steps below are slow we are not mistaking this for a
+		 * wall-time timeout. */
+		disarm_timer();
 
 		check_remaining_procs();
 
@@ -1605,12 +2355,16 @@ int main(int argc, char **argv)
 		write_meta("stdin-bytes", "%zu",data_read[0]);
 		write_meta("stdout-bytes","%zu",data_read[1]);
 		write_meta("stderr-bytes","%zu",data_read[2]);
+		if ( tee_ok ) write_meta("stdout-tee-bytes","%zu",data_passed[1]);
+
+		/* In interactive mode the validator determines the outcome. */
+		if ( interactive ) exitcode = output_validator_meta();
 
 		if ( outputmeta && fclose(metafile)!=0 ) {
 			error(errno,"closing file `%s'",metafilename);
 		}
 
-		/* Return the exitstatus of the command */
+		/* Return the exitstatus of the command (or validator) */
 		return exitcode;
 	}
 
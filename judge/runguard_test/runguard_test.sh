@@ -115,6 +115,39 @@ test_streamsize_stderr() {
 	[ $limit -gt $actual ] || fail "stdout not limited to ${limit}B, but wrote ${actual}B"
 }
 
+test_stdout_tee() {
+	teedir=$(mktemp -d -p "$judgehost_tmpdir")
+	mkfifo "$teedir/fifo"
+	cat "$teedir/fifo" > "$teedir/copy" &
+	exec_check_fail sudo $RUNGUARD $RUNGUARD_OPTIONS -t 1 -s 123 -M "$META" -S "$teedir/fifo" yes DOMjudge
+	wait
+	cmp -s "$LOG1" "$teedir/copy" || fail "stdout copy differs from stdout"
+	expect_meta 'stdout-tee-bytes: 125952'
+
+	# The copy stops when its reader does.
+	head -c 10 "$teedir/fifo" > /dev/null &
+	exec_check_success sudo $RUNGUARD $RUNGUARD_OPTIONS -M "$META" -S "$teedir/fifo" seq 100000
+	wait
+	expect_stdout "100000"
+	expect_meta 'stdout-tee-bytes: 588895'
+
+	# A reader that lags behind loses the copy, without throttling the
+	# command.
+	{ sleep 2; cat > /dev/null; } < "$teedir/fifo" &
+	exec_check_fail sudo $RUNGUARD $RUNGUARD_OPTIONS -t 1 -s 10000 -M "$META" -S "$teedir/fifo" yes DOMjudge
+	wait
+	actual=$(wc -c < "$LOG1")
+	[ $actual -eq $((10000*1024)) ] || fail "stdout throttled by its copy, wrote ${actual}B"
+	grep -q 'stdout-tee-bytes' "$META" && fail "stdout copy reported with a lagging reader"
+
+	# Without a reader the command runs without the copy.
+	exec_check_success sudo $RUNGUARD $RUNGUARD_OPTIONS -M "$META" -S "$teedir/fifo" echo foobar
+	expect_stderr "not copying stdout"
+	grep -q 'stdout-tee-bytes' "$META" && fail "stdout copy reported without a reader"
+
+	rm -rf "$teedir"
+}
+
 test_redir_stdout() {
 	stdout=$(mktemp -p "$judgehost_tmpdir")
 	chmod go+rwx "$stdout"
@@ -190,6 +223,28 @@ test_rootdir_changedir() {
 	expect_stdout "Hello DOMjudge"
 }
 
+test_bind_mount() {
+	# shellcheck disable=SC2154
+	bind_dir="$judgehost_judgedir/runguard_tests/bind"
+	mkdir -p "$bind_dir"/root/mnt "$bind_dir"/src
+	cp hello "$bind_dir"/src/
+
+	exec_check_success sudo $RUNGUARD $RUNGUARD_OPTIONS -r "$bind_dir/root" -B "$bind_dir/src:/mnt" /mnt/hello
+	expect_stdout "Hello DOMjudge"
+	[ -e "$bind_dir/root/mnt/hello" ] && fail "bind mount visible outside runguard"
+
+	exec_check_fail sudo $RUNGUARD $RUNGUARD_OPTIONS -r "$bind_dir/root" -B "/etc:/mnt" /mnt/hello
+	expect_stderr "invalid bind source"
+
+	exec_check_fail sudo $RUNGUARD $RUNGUARD_OPTIONS -r "$bind_dir/root" -B "$bind_dir/src:../.." /mnt/hello
+	expect_stderr "invalid bind target"
+
+	exec_check_fail sudo $RUNGUARD $RUNGUARD_OPTIONS -B "$bind_dir/src:/mnt" /mnt/hello
+	expect_stderr "requires option \`root'"
+
+	rm -rf "$bind_dir"
+}
+
 test_memsize() {
 	# This is slightly over the limit as there is other stuff to be allocated as well.
 	exec_check_fail sudo $RUNGUARD $RUNGUARD_OPTIONS -m 1024 ./mem $((1024*1024))
@@ -273,6 +328,49 @@ test_meta() {
 	expect_meta 'output-truncated: stderr'
 }
 
+test_interactive() {
+	VALMETA=$(mktemp -p "$judgehost_tmpdir")
+	INTERACTLOG=$(mktemp -p "$judgehost_tmpdir")
+	validator='echo 21; read answer; [ "$answer" = 42 ] && exit 42; exit 43'
+
+	# The exitcode of runguard is that of the validator.
+	sudo $RUNGUARD $RUNGUARD_OPTIONS -t 2 -M "$META" --interactive -W "$VALMETA" -O "$INTERACTLOG" \
+		sh -c "$validator" = sh -c 'read x; echo $((2*x))' > "$LOG1" 2> "$LOG2"
+	[ $? -eq 42 ] || fail "expected validator exitcode 42, stderr: $(head "$LOG2")"
+	expect_meta 'exitcode: 0'
+	expect_file "$VALMETA" 'exitcode: 42'
+	expect_file "$INTERACTLOG" '>: 21'
+	expect_file "$INTERACTLOG" '<: 42'
+
+	sudo $RUNGUARD $RUNGUARD_OPTIONS -t 2 -M "$META" --interactive -W "$VALMETA" \
+		sh -c "$validator" = echo 41 > "$LOG1" 2> "$LOG2"
+	[ $? -eq 43 ] || fail "expected validator exitcode 43, stderr: $(head "$LOG2")"
+	expect_file "$VALMETA" 'exitcode: 43'
+
+	# A validator that gives up early wins over a command that keeps waiting.
+	sudo $RUNGUARD $RUNGUARD_OPTIONS -t 1 -M "$META" --interactive -W "$VALMETA" \
+		sh -c 'exit 43' = sleep 3 > "$LOG1" 2> "$LOG2"
+	[ $? -eq 43 ] || fail "expected validator exitcode 43, stderr: $(head "$LOG2")"
+	expect_meta 'time-result: hard-timelimit'
+	expect_file "$VALMETA" 'validator-exited-first: true'
+
+	# In low-latency mode the batched interaction log is still complete.
+	validator='for i in $(seq 1000); do echo $i; read a; [ "$a" = $i ] || exit 43; done; exit 42'
+	sudo $RUNGUARD $RUNGUARD_OPTIONS -t 5 -M "$META" --interactive -W "$VALMETA" -O "$INTERACTLOG" \
+		--low-latency --proxy-cpu=0 sh -c "$validator" = sh -c 'while read x; do echo $x; done' > "$LOG1" 2> "$LOG2"
+	[ $? -eq 42 ] || fail "expected validator exitcode 42, stderr: $(head "$LOG2")"
+	[ "$(grep -c '^\[.*\]<: ' "$INTERACTLOG")" -eq 1000 ] || fail "incomplete interaction log"
+	expect_file "$INTERACTLOG" '>: 1000'
+
+	# A validator exceeding its budget is reported separately.
+	sudo $RUNGUARD $RUNGUARD_OPTIONS -t 3 -M "$META" --interactive -W "$VALMETA" -T 0.5 \
+		sh -c 'while :; do :; done' = true > "$LOG1" 2> "$LOG2"
+	expect_file "$VALMETA" 'validator-time-result: timelimit'
+	grep -q 'time-result: .*timelimit' "$META" && fail "validator budget reported as command timelimit"
+
+	rm -f "$VALMETA" "$INTERACTLOG"
+}
+
 any_test_failed=0
 only_func=$1
 for func in $(compgen -o nosort -A function test_); do
@@ -59,6 +59,30 @@
 // stdin   <-----  epoll  <----- stdout
 // SIGCHLD ----------^
 // SIGUSR1 ----------^
+//
+// For interactions with many tiny messages the latency of a round trip is
+// dominated by the wakeups of the proxy. In low-latency mode (-l) the proxy
+// pipes are registered edge-triggered, the proxy busy-polls epoll for a short,
+// adaptive amount of time before going to sleep, and the writes to the output
+// file are batched and only flushed before sleeping. The proxy can also be
+// pinned to a CPU (-c), typically one next to the core the submission runs on.
+//
+// Validator time budget
+// ---------------------
+//
+// With -t the CPU time of the first process (the validator) is checked
+// periodically using a timerfd in the epoll. When it exceeds the budget, the
+// validator is killed and this is reported separately in the metadata file,
+// so that it is not mistaken for a time limit of the submission.
+//
+// Replay mode
+// -----------
+//
+// With --replay only the first process (the validator) is spawned. The data
+// that the second process sent according to an interaction log written with
+// -o is fed to its stdin as fast as it reads it, and its stdout is drained.
+// This allows re-checking recorded interactions against a changed validator
+// without running the submission again.
 
 #include "config.h"
 
@@ -70,10 +94,15 @@
 #include <fcntl.h>
 #include <fstream>
 #include <getopt.h>
+#include <memory>
+#include <poll.h>
+#include <sched.h>
 #include <signal.h>
 #include <sstream>
 #include <string>
 #include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <tuple>
 #include <unistd.h>
@@ -276,6 +305,7 @@ struct process_t {
       logmsg(LOG_DEBUG, "closing fd: %d (proxy -> process) of %d",
              proxy_to_process, pid);
       close(proxy_to_process);
+      proxy_to_process = -1;
     }
   }
 
@@ -286,6 +316,8 @@ struct process_t {
       logmsg(LOG_DEBUG, "closing fd: %d (process -> proxy) of %d",
              process_to_proxy, pid);
       close(process_to_proxy);
+      // Pending epoll events for this fd must not match it anymore.
+      process_to_proxy = -1;
     }
   }
 
@@ -311,19 +343,31 @@ struct process_t {
 //   bytes: the number of bytes of "content"
 //   direction: > if "content" is sent by the main process, < otherwise
 //   content: a sequence of "bytes" bytes, followed by a new-line
+//
+// An end of file is written as the header only, with direction ] or [.
 struct output_file_t {
   // The file descriptor of the file where to write.
   fd_t output_file = -1;
 
   chrono::time_point<chrono::steady_clock> start;
 
-  output_file_t(string path) {
+  // When batching, the data is collected here and only written on flush() or
+  // when the buffer is full.
+  bool batched = false;
+  static const size_t BATCH_SIZE = 1024 * 1024;
+  unique_ptr<char[]> batch;
+  size_t batch_len = 0;
+
+  output_file_t(string path, bool batched = false) : batched(batched) {
     // If the output file is not enable this struct only does noops.
     if (path.empty()) {
       return;
     }
 
     start = chrono::steady_clock::now();
+    if (batched) {
+      batch.reset(new char[BATCH_SIZE]);
+    }
     output_file = open(path.c_str(), O_CREAT | O_CLOEXEC | O_WRONLY | O_TRUNC,
                        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
     if (output_file == -1) {
@@ -340,18 +384,42 @@ struct output_file_t {
     if (output_file == -1) {
       return;
     }
+    flush();
     if (close(output_file)) {
       error(errno, "failed to close proxy output file");
     }
   }
 
-  // Write all the data into the output file, including the header of this
-  // message. The buffer should be at least long size+1.
-  void write(char *buffer, ssize_t size, const process_t &from) {
-    if (output_file == -1) {
+  // Write out the batched data, if any.
+  void flush() {
+    if (output_file == -1 || batch_len == 0) {
+      return;
+    }
+    write_all(output_file, batch.get(), batch_len);
+    batch_len = 0;
+  }
+
+  // Write data to the file, or append it to the batch.
+  void emit(const char *data, size_t size) {
+    if (!batched) {
+      write_all(output_file, data, size);
+      return;
+    }
+    if (batch_len + size > BATCH_SIZE) {
+      flush();
+    }
+    if (size > BATCH_SIZE) {
+      write_all(output_file, data, size);
       return;
     }
+    memcpy(batch.get() + batch_len, data, size);
+    batch_len += size;
+  }
 
+  // Format the header of a message into the buffer, returning its length.
+  // The buffer must be at least HEADER_SIZE long.
+  static const size_t HEADER_SIZE = 64;
+  int format_header(char *header, ssize_t size, char direction, bool eof) {
     // The runtime is converted into sec + millis manually instead of with %f
     // because benchmarks showed that it's quite expensive.
     auto duration = chrono::steady_clock::now() - start;
@@ -359,33 +427,65 @@ struct output_file_t {
     int time_sec = time / 1000;
     int time_millis = time % 1000;
 
-    const size_t HEADER_SIZE = 64;
-    char header[HEADER_SIZE];
-
-    char direction = from.index == 0 ? '>' : '<';
     int header_len =
-        snprintf(header, HEADER_SIZE, "[%3d.%03ds/%ld]%c: ", time_sec,
-                 time_millis, size, direction);
+        snprintf(header, HEADER_SIZE, "[%3d.%03ds/%ld]%c%s", time_sec,
+                 time_millis, size, direction, eof ? "" : ": ");
     // Check that snprintf didn't truncate the header.
-    if (header_len >= static_cast<int>(HEADER_SIZE)) {
+    if (header_len < 0 || header_len >= static_cast<int>(HEADER_SIZE)) {
       error(0, "header size too small: %d > %ld", header_len, HEADER_SIZE);
     }
+    return header_len;
+  }
+
+  // Write all the data into the output file, including the header of this
+  // message. The buffer should be at least long size+1.
+  void write(char *buffer, ssize_t size, const process_t &from) {
+    if (output_file == -1) {
+      return;
+    }
+
+    char header[HEADER_SIZE];
+    char direction = from.index == 0 ? '>' : '<';
+    int header_len = format_header(header, size, direction, false);
 
-    write_all(output_file, header, header_len);
+    emit(header, header_len);
     buffer[size] = '\n'; // avoids another call to write_all just for the \n
-    write_all(output_file, buffer, size + 1);
+    emit(buffer, size + 1);
+  }
+
+  // Write that the process closed its output.
+  void write_eof(const process_t &from) {
+    if (output_file == -1) {
+      return;
+    }
+
+    char header[HEADER_SIZE];
+    char direction = from.index == 0 ? ']' : '[';
+    int header_len = format_header(header, 0, direction, true);
+
+    emit(header, header_len);
   }
 };
 
 void usage() {
   printf("\
 Usage: %s [OPTION]... COMMAND1 [ARGS...] = COMMAND2 [ARGS...]\n\
+   or: %s [OPTION]... --replay=LOG COMMAND1 [ARGS...]\n\
 Run two commands with stdin/stdout bi-directionally connected.\n\
 \n",
-         progname);
+         progname, progname);
   printf("\
   -o, --outprog=FILE   write stdout from second program to FILE\n\
   -M, --outmeta=FILE   write metadata (runtime, exit_code, etc.) of first program to FILE\n\
+  -l, --low-latency    minimize proxy latency for many small messages, at the\n\
+                         cost of busy-polling a CPU for short periods\n\
+  -c, --cpu=CPU        pin the proxy to CPU\n\
+  -t, --valtime=SEC    kill the first program when it used more than SEC\n\
+                         seconds of CPU time\n\
+  -r, --replay=LOG     feed the second program's side of interaction log LOG\n\
+                         (as written by -o) to the first program\n\
+  -e, --expect=CODE    with --replay, report whether the first program still\n\
+                         exits with CODE\n\
   -v, --verbose        display some extra warnings and information\n\
   -h, --help           display this help and exit\n\
       --version        output version information and exit\n\
@@ -404,6 +504,11 @@ struct state_t {
     int show_version = 0;
     string output_file;
     string meta_file;
+    bool low_latency = false;
+    int pin_cpu = -1;
+    string replay_file;
+    int expect_exitcode = -1;
+    double validator_time = -1;
   } args;
 
   // The N_PROC processes to execute.
@@ -424,6 +529,14 @@ struct state_t {
   // The file descriptor of the epoll.
   fd_t epoll_fd = -1;
 
+  // The timer used to periodically check the CPU time of the validator, if it
+  // has a time budget.
+  fd_t validator_timer = -1;
+  // Whether the validator was killed for exceeding its time budget.
+  bool validator_timelimit_exceeded = false;
+  // The CPU time used by the validator, in seconds, as reported at its exit.
+  double validator_cpu_time = 0;
+
   // The instant of when the whole process started. It's used to write the total
   // runtime in the metadata file.
   chrono::time_point<chrono::high_resolution_clock> start =
@@ -432,6 +545,12 @@ struct state_t {
   // filled only if the proxy is active.
   size_t total_bytes_transferred = 0;
 
+  // In low-latency mode, how long to busy-poll before blocking in epoll. This
+  // adapts between the bounds below depending on whether polling pays off.
+  const chrono::microseconds MIN_SPIN{5};
+  const chrono::microseconds MAX_SPIN{200};
+  chrono::microseconds spin_budget{50};
+
   state_t(int argc, char **argv) {
     parse_flags(argc, argv);
     parse_commands(argc, argv);
@@ -445,13 +564,19 @@ struct state_t {
       {"version", no_argument,       &args.show_version, 1  },
       {"outprog", required_argument, nullptr,            'o'},
       {"outmeta", required_argument, nullptr,            'M'},
+      {"low-latency", no_argument,   nullptr,            'l'},
+      {"cpu",     required_argument, nullptr,            'c'},
+      {"valtime", required_argument, nullptr,            't'},
+      {"replay",  required_argument, nullptr,            'r'},
+      {"expect",  required_argument, nullptr,            'e'},
       { nullptr,  0,                 nullptr,             0 }
     };
     // clang-format on
 
     progname = argv[0];
     int opt = -1;
-    while ((opt = getopt_long(argc, argv, "+o:M:vh", long_opts, NULL)) != -1) {
+    char *endptr = nullptr;
+    while ((opt = getopt_long(argc, argv, "+o:M:lc:t:r:e:vh", long_opts, NULL)) != -1) {
       switch (opt) {
       case 0: /* long-only option */
         break;
@@ -469,6 +594,34 @@ struct state_t {
         args.meta_file = optarg;
         logmsg(LOG_DEBUG, "writing metadata to '%s'", args.meta_file.c_str());
         break;
+      case 'l': /* low-latency option */
+        args.low_latency = true;
+        logmsg(LOG_DEBUG, "low-latency mode enabled");
+        break;
+      case 'c': /* cpu option */
+        args.pin_cpu = strtol(optarg, &endptr, 10);
+        if (*endptr != 0 || args.pin_cpu < 0 || args.pin_cpu >= CPU_SETSIZE) {
+          error(0, "invalid cpu specified: `%s'", optarg);
+        }
+        break;
+      case 't': /* valtime option */
+        args.validator_time = strtod(optarg, &endptr);
+        if (*endptr != 0 || args.validator_time <= 0) {
+          error(0, "invalid validator time specified: `%s'", optarg);
+        }
+        break;
+      case 'r': /* replay option */
+        args.replay_file = optarg;
+        logmsg(LOG_DEBUG, "replaying interactions from '%s'",
+               args.replay_file.c_str());
+        break;
+      case 'e': /* expect option */
+        args.expect_exitcode = strtol(optarg, &endptr, 10);
+        if (*endptr != 0 || args.expect_exitcode < 0 ||
+            args.expect_exitcode > 255) {
+          error(0, "invalid exitcode specified: `%s'", optarg);
+        }
+        break;
       case 'h':
         args.show_help = 1;
         break;
@@ -492,6 +645,12 @@ struct state_t {
       logmsg(LOG_ERR, "no command specified");
       exit(1);
     }
+    if (args.expect_exitcode != -1 && !is_replay()) {
+      error(0, "--expect can only be used with --replay");
+    }
+    if (args.validator_time >= 0 && is_replay()) {
+      error(0, "--valtime cannot be used with --replay");
+    }
   }
 
   // Parse the N_PROC commands separated by '='.
@@ -532,7 +691,12 @@ struct state_t {
       process.args.emplace_back(move(arg));
     }
 
-    if (processes.back().cmd.empty()) {
+    // In replay mode the second process is only read from the log.
+    if (is_replay() && current_process_index != 0) {
+      logmsg(LOG_ERR, "you should provide 1 command with --replay");
+      exit(1);
+    }
+    if (!is_replay() && processes.back().cmd.empty()) {
       logmsg(LOG_ERR, "you should provide %d commands", N_PROC);
       exit(1);
     }
@@ -549,6 +713,8 @@ struct state_t {
 
   bool has_proxy() { return !args.output_file.empty(); }
 
+  bool is_replay() { return !args.replay_file.empty(); }
+
   // Install an handler for the SIGTERM signal. This will send SIGTERM to all
   // the children and then restore the default signal handler.
   void install_sigterm_handler() {
@@ -729,11 +895,11 @@ struct state_t {
       error(errno, "error creating epoll");
     }
 
-    auto add_fd = [&](fd_t fd) {
+    auto add_fd = [&](fd_t fd, uint32_t events) {
       logmsg(LOG_DEBUG, "epoll will listen for fd %d", fd);
       epoll_event ev{};
       ev.data.fd = fd;
-      ev.events = EPOLLIN;
+      ev.events = events;
       if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
         error(errno, "failed to add fd %d to epoll", fd);
       }
@@ -743,18 +909,25 @@ struct state_t {
     if (child_exited_pipe == -1) {
       error(0, "SIGCHLD handler not installed");
     }
-    add_fd(child_exited_pipe);
+    add_fd(child_exited_pipe, EPOLLIN);
 
     // Always listen for child timelimit events.
     if (child_timelimit_pipe == -1) {
         error(0, "SIGUSR1 handler not installed");
     }
-    add_fd(child_timelimit_pipe);
+    add_fd(child_timelimit_pipe, EPOLLIN);
+
+    if (validator_timer != -1) {
+      add_fd(validator_timer, EPOLLIN);
+    }
 
-    // Listen for incoming data only when proxy is enabled.
+    // Listen for incoming data only when proxy is enabled. The pipes are
+    // always drained until EAGAIN, so edge-triggered mode saves re-arming
+    // them on every wakeup.
     if (has_proxy()) {
       for (auto &proc : processes) {
-        add_fd(proc.process_to_proxy);
+        add_fd(proc.process_to_proxy,
+               args.low_latency ? EPOLLIN | EPOLLET : EPOLLIN);
       }
     }
   }
@@ -773,8 +946,9 @@ struct state_t {
     }
 
     int status = -1;
+    struct rusage usage {};
     // Check if a child exited without blocking.
-    pid_t pid = waitpid(-1, &status, WNOHANG);
+    pid_t pid = wait4(-1, &status, WNOHANG, &usage);
     if (pid < 0) {
       error(errno, "failed to wait for child exit");
     }
@@ -785,6 +959,11 @@ struct state_t {
 
     logmsg(LOG_DEBUG, "child with pid %d exited", pid);
 
+    if (pid == main_process().pid) {
+      validator_cpu_time = timeval_to_seconds(usage.ru_utime) +
+                           timeval_to_seconds(usage.ru_stime);
+    }
+
     // Only set the first process if runguard didn't tell us about a TLE.
     if (first_process_exit_id == -1 && !child_indicated_timelimit) {
       first_process_exit_id = pid;
@@ -838,14 +1017,7 @@ struct state_t {
       // write an extra \n at its end.
       ssize_t nread = read(from.process_to_proxy, buffer, BUF_SIZE - 1);
       if (nread == 0) {
-        auto duration = chrono::steady_clock::now() - output_file.start;
-        auto time = duration.count() / 1000 / 1000; // ns -> ms
-        int time_sec = time / 1000;
-        int time_millis = time % 1000;
-        char direction = from.index == 0 ? ']' : '[';
-        char eofbuf[128];
-        sprintf(eofbuf, "[%3d.%03ds/%ld]%c", time_sec, time_millis, 0L, direction);
-        write_all(output_file.output_file, eofbuf, strlen(eofbuf));
+        output_file.write_eof(from);
 
         warning(0, "EOF from process #%ld", from.index);
         // The process closed stdout, we need to close the pipe's file
@@ -871,18 +1043,118 @@ struct state_t {
     error(0, "unexpected exit from pump loop");
   };
 
+  // Wait for events on the epoll. In low-latency mode first poll without
+  // blocking for at most spin_budget, growing the budget when an event
+  // arrives in time and shrinking it otherwise. Batched output is flushed
+  // before going to sleep.
+  int wait_for_events(epoll_event *events, int max_events,
+                      output_file_t &output_file) {
+    if (args.low_latency) {
+      auto deadline = chrono::steady_clock::now() + spin_budget;
+      do {
+        int num_events = epoll_wait(epoll_fd, events, max_events, 0);
+        if (num_events != 0) {
+          if (num_events > 0) {
+            spin_budget = min(spin_budget * 2, MAX_SPIN);
+          }
+          return num_events;
+        }
+      } while (chrono::steady_clock::now() < deadline);
+      spin_budget = max(spin_budget / 2, MIN_SPIN);
+    }
+    output_file.flush();
+    return epoll_wait(epoll_fd, events, max_events, -1);
+  }
+
+  static double timeval_to_seconds(const timeval &tv) {
+    return tv.tv_sec + tv.tv_usec * 1E-6;
+  }
+
+  // Start the timer checking the validator time budget, if any.
+  void start_validator_timer() {
+    if (args.validator_time < 0) {
+      return;
+    }
+    validator_timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (validator_timer == -1) {
+      error(errno, "failed to create validator timer");
+    }
+    // Check often enough to not overshoot small budgets by much, but don't
+    // wake up the proxy too often for large ones.
+    long interval_ns = min(100 * 1000 * 1000L,
+                           max(1000 * 1000L, (long)(args.validator_time * 1E8)));
+    itimerspec spec{};
+    spec.it_interval.tv_sec = spec.it_value.tv_sec = 0;
+    spec.it_interval.tv_nsec = spec.it_value.tv_nsec = interval_ns;
+    if (timerfd_settime(validator_timer, 0, &spec, nullptr)) {
+      error(errno, "failed to start validator timer");
+    }
+    logmsg(LOG_DEBUG, "checking validator time every %ld ms",
+           interval_ns / 1000 / 1000);
+  }
+
+  // Check the CPU time the validator used so far and kill it when it exceeds
+  // its budget. This does not include CPU time of its children.
+  void check_validator_time() {
+    uint64_t expirations;
+    if (read(validator_timer, &expirations, sizeof(expirations)) < 0 &&
+        errno != EAGAIN && errno != EWOULDBLOCK) {
+      error(errno, "failed to read from validator timer");
+    }
+
+    process_t &validator = main_process();
+    if (validator.exited || validator_timelimit_exceeded) {
+      return;
+    }
+    clockid_t clock_id;
+    timespec cpu_time;
+    if (clock_getcpuclockid(validator.pid, &clock_id) ||
+        clock_gettime(clock_id, &cpu_time)) {
+      // The validator may just have exited, so try again on the next tick.
+      logmsg(LOG_DEBUG, "failed to get validator cpu time");
+      return;
+    }
+    double used = cpu_time.tv_sec + cpu_time.tv_nsec * 1E-9;
+    if (used > args.validator_time) {
+      logmsg(LOG_WARNING, "validator exceeded its time budget: %.3f > %.3f",
+             used, args.validator_time);
+      validator_timelimit_exceeded = true;
+      if (kill(validator.pid, SIGKILL)) {
+        error(errno, "failed to kill validator");
+      }
+    }
+  }
+
+  // Pin this process to the requested CPU, if any. This is called after the
+  // children are spawned, so that they don't inherit the affinity.
+  void pin_to_cpu() {
+    if (args.pin_cpu < 0) {
+      return;
+    }
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(args.pin_cpu, &cpuset);
+    if (sched_setaffinity(0, sizeof(cpuset), &cpuset)) {
+      warning(errno, "failed to pin to cpu %d", args.pin_cpu);
+      return;
+    }
+    logmsg(LOG_DEBUG, "pinned to cpu %d", args.pin_cpu);
+  }
+
   // Start listening for file events and block until all the processes exit.
   void epoll_loop() {
-    output_file_t output_file(args.output_file);
+    output_file_t output_file(args.output_file, args.low_latency);
 
-    // We can only receive 2 types of events:
+    // We can only receive 4 types of events:
     // - a child exited
+    // - a child indicated a time limit
+    // - the validator timer expired
     // - some data is ready in an proxy's pipe (at most N_PROC)
-    const int MAX_EVENTS = 1 + N_PROC;
+    const int MAX_EVENTS = 3 + N_PROC;
     epoll_event events[MAX_EVENTS];
     while (true) {
       // This will block until an event is ready.
-      int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+      int num_events = wait_for_events(events, MAX_EVENTS, output_file);
       if (num_events == -1) {
         // When a signal is triggered, epoll_wait exits with EINTR, but that's
         // ok for us. We can just wait again.
@@ -913,6 +1185,10 @@ struct state_t {
           }
           continue;
         }
+        if (fd == validator_timer) {
+          check_validator_time();
+          continue;
+        }
         if (fd == child_timelimit_pipe) {
             static char buffer[1];
             if (read(child_timelimit_pipe, buffer, 1) != 1) {
@@ -951,6 +1227,144 @@ struct state_t {
     }
   }
 
+  // Read the interaction log and return everything that the second process
+  // sent, in order. See output_file_t for the format.
+  string read_replay_log() {
+    ifstream log(args.replay_file, ios::binary);
+    if (log.fail()) {
+      error(errno, "failed to open replay log at %s", args.replay_file.c_str());
+    }
+    string content((istreambuf_iterator<char>(log)), istreambuf_iterator<char>());
+
+    // Parse a number followed by the given separator, advancing ptr.
+    auto parse_number = [](const char *&ptr, const char *sep) {
+      char *end;
+      long value = strtol(ptr, &end, 10);
+      if (end == ptr || strncmp(end, sep, strlen(sep)) != 0) {
+        return -1L;
+      }
+      ptr = end + strlen(sep);
+      return value;
+    };
+
+    string data;
+    size_t pos = 0;
+    while (pos < content.size()) {
+      // Parse the header "[time_in_seconds/bytes]direction". Note that the
+      // content can contain NUL bytes, so we cannot use sscanf.
+      const char *header = content.c_str() + pos;
+      const char *ptr = header + 1;
+      long size = -1;
+      if (*header != '[' || parse_number(ptr, ".") < 0 ||
+          parse_number(ptr, "s/") < 0 || (size = parse_number(ptr, "]")) < 0 ||
+          ptr >= content.c_str() + content.size()) {
+        error(0, "malformed replay log at offset %ld", pos);
+      }
+      char direction = *ptr++;
+      pos += ptr - header;
+      // An EOF marker has no content.
+      if (direction == ']' || direction == '[') {
+        continue;
+      }
+      if (content.compare(pos, 2, ": ") != 0 ||
+          pos + 2 + size >= content.size() || content[pos + 2 + size] != '\n') {
+        error(0, "malformed replay log at offset %ld", pos);
+      }
+      if (direction == '<') {
+        data.append(content, pos + 2, size);
+      }
+      pos += 2 + size + 1;
+    }
+    return data;
+  }
+
+  // Run the first process with the second process' side of the replay log as
+  // input, draining and discarding its output.
+  void replay() {
+    string data = read_replay_log();
+    logmsg(LOG_DEBUG, "replaying %ld bytes", data.size());
+
+    process_t &proc = main_process();
+    fd_t to_proc[2], from_proc[2];
+    if (pipe2(to_proc, O_CLOEXEC) || pipe2(from_proc, O_CLOEXEC)) {
+      error(errno, "creating pipes");
+    }
+    resize_pipe(to_proc[1]);
+    proc.stdin_fd = to_proc[0];
+    proc.stdout_fd = from_proc[1];
+    proc.spawn();
+    set_non_blocking(to_proc[1]);
+    set_non_blocking(from_proc[0]);
+
+    pollfd fds[2] = {{from_proc[0], POLLIN, 0}, {to_proc[1], POLLOUT, 0}};
+    size_t written = 0;
+    const size_t BUF_SIZE = 64 * 1024;
+    char buffer[BUF_SIZE];
+    if (data.empty()) {
+      close(to_proc[1]);
+      fds[1].fd = -1;
+    }
+    // Stop when the process closes its stdout, which normally means it exited.
+    while (fds[0].fd != -1) {
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        error(errno, "failed to poll");
+      }
+      if (fds[0].revents) {
+        ssize_t nread = read(fds[0].fd, buffer, BUF_SIZE);
+        if (nread < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+          error(errno, "failed to read from pipe of #0");
+        }
+        if (nread == 0) {
+          close(fds[0].fd);
+          fds[0].fd = -1;
+        }
+      }
+      if (fds[1].fd != -1 && fds[1].revents) {
+        ssize_t nwrite = write(fds[1].fd, data.data() + written,
+                               data.size() - written);
+        if (nwrite > 0) {
+          written += nwrite;
+          total_bytes_transferred += nwrite;
+        }
+        // All data written, or the process closed its stdin.
+        if (written == data.size() ||
+            (nwrite < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+          close(fds[1].fd);
+          fds[1].fd = -1;
+        }
+      }
+    }
+    if (fds[1].fd != -1) {
+      close(fds[1].fd);
+    }
+
+    int status;
+    struct rusage usage {};
+    if (wait4(proc.pid, &status, 0, &usage) < 0) {
+      error(errno, "failed to wait for child exit");
+    }
+    proc.on_exit(status);
+    validator_cpu_time = timeval_to_seconds(usage.ru_utime) +
+                         timeval_to_seconds(usage.ru_stime);
+    // The validator exited first if it did not consume all the replayed data.
+    if (written < data.size()) {
+      first_process_exit_id = proc.pid;
+    }
+
+    if (args.expect_exitcode != -1) {
+      if (proc.exit_code() == args.expect_exitcode) {
+        logmsg(LOG_INFO, "replay verdict unchanged: %s",
+               proc.exit_info_to_string().c_str());
+      } else {
+        logmsg(LOG_WARNING, "replay verdict changed: expected exitcode %d, %s",
+               args.expect_exitcode, proc.exit_info_to_string().c_str());
+      }
+    }
+  }
+
   // Write the metadata to file, if enabled.
   void write_meta() {
     if (args.meta_file.empty()) {
@@ -969,6 +1383,17 @@ struct state_t {
     meta << "validator-exited-first: "
          << (first_process_exit_id == main_process().pid ? "true" : "false")
          << endl;
+    meta << "validator-cpu-time: " << validator_cpu_time << endl;
+    if (args.validator_time >= 0) {
+      meta << "validator-time-result: "
+           << (validator_timelimit_exceeded ? "timelimit" : "") << endl;
+    }
+    if (args.expect_exitcode != -1) {
+      meta << "replay-verdict-matches: "
+           << (main_process().exit_code() == args.expect_exitcode ? "true"
+                                                                 : "false")
+           << endl;
+    }
   }
 };
 
@@ -983,6 +1408,16 @@ int main(int argc, char **argv) {
   // errors.
   signal(SIGPIPE, SIG_IGN);
   state.install_sigterm_handler();
+  if (state.is_replay()) {
+    state.replay();
+    state.write_meta();
+    int exit_code = state.main_process().exit_code();
+    if (exit_code != -1) {
+      return exit_code;
+    }
+    error(0, "the first process crashed! %s",
+          state.main_process().exit_info_to_string().c_str());
+  }
   state.install_sigchld_handler();
   state.install_sigusr1_handler();
   state.setup_pipes();
@@ -990,6 +1425,8 @@ int main(int argc, char **argv) {
     proc.spawn();
   }
 
+  state.pin_to_cpu();
+  state.start_validator_timer();
   state.init_epoll();
   state.epoll_loop();
   state.write_meta();
@@ -0,0 +1,13 @@
+#include <signal.h>
+#include <stdio.h>
+
+int main() {
+  signal(SIGPIPE, SIG_IGN);
+  printf("123\n");
+  fflush(stdout);
+
+  // Keep the CPU busy well beyond the validator time budget.
+  volatile unsigned long x = 0;
+  while (1)
+    x++;
+}
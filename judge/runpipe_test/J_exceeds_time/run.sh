@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+
+[[ $# != 1 ]] && echo "Usage: $0 runpipe" && exit 2
+
+source ../check.sh
+# The judge is killed, so runpipe reports that the first process crashed.
+should_exit_with 255 "$1" -t 0.2 -M meta.txt ./judge = ./solution
+grep -q "validator-time-result: timelimit" meta.txt || exit 1
+should_exit_with 255 "$1" -t 0.2 -M meta.txt -o output.txt ./judge = ./solution
+grep -q "validator-time-result: timelimit" meta.txt || exit 1
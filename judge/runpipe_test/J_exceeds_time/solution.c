@@ -0,0 +1,7 @@
+#include <stdio.h>
+
+int main() {
+  int x;
+  while (scanf("%d", &x) == 1) {
+  }
+}
@@ -0,0 +1,29 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Do many tiny round trips and report the average round trip time, to
+// measure the latency added by runpipe.
+int main(int argc, char **argv) {
+  signal(SIGPIPE, SIG_IGN);
+  int rounds = argc > 1 ? atoi(argv[1]) : 10000;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < rounds; i++) {
+    printf("%d\n", i);
+    fflush(stdout);
+    int x;
+    if (scanf("%d", &x) != 1 || x != i + 1)
+      return 43;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double us = (end.tv_sec - start.tv_sec) * 1e6 +
+              (end.tv_nsec - start.tv_nsec) / 1e3;
+  fprintf(stderr, "%d round trips, average %.2f us\n", rounds, us / rounds);
+  return 42;
+}
@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+
+[[ $# != 1 ]] && echo "Usage: $0 runpipe" && exit 2
+
+source ../check.sh
+should_exit_with 42 "$1" ./judge 10000 = ./solution
+should_exit_with 42 "$1" -o output.txt ./judge 10000 = ./solution
+should_exit_with 42 "$1" -l -o output.txt ./judge 10000 = ./solution
+should_exit_with 42 "$1" -l -c 0 -o output.txt ./judge 10000 = ./solution
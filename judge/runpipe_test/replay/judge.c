@@ -0,0 +1,18 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Ask for a few numbers and accept if the last answer equals argv[1].
+int main(int argc, char **argv) {
+  signal(SIGPIPE, SIG_IGN);
+  int expected = atoi(argv[1]);
+
+  int x = -1;
+  for (int i = 0; i < 3; i++) {
+    printf("%d\n", i);
+    fflush(stdout);
+    if (scanf("%d", &x) != 1)
+      return 43;
+  }
+  return x == expected ? 42 : 43;
+}
@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+
+[[ $# != 1 ]] && echo "Usage: $0 runpipe" && exit 2
+
+source ../check.sh
+should_exit_with 42 "$1" -o output.txt ./judge 123 = ./solution
+
+# Replaying the log gives the same verdict with the same judge...
+should_exit_with 42 "$1" -M meta.txt --replay output.txt --expect 42 ./judge 123
+grep -q "replay-verdict-matches: true" meta.txt || exit 1
+
+# ...and a different one when the judge changed.
+should_exit_with 43 "$1" -M meta.txt --replay output.txt --expect 42 ./judge 124
+grep -q "replay-verdict-matches: false" meta.txt || exit 1
@@ -0,0 +1,9 @@
+#include <stdio.h>
+
+int main() {
+  int x;
+  while (scanf("%d", &x) == 1) {
+    printf("%d\n", 121 + x);
+    fflush(stdout);
+  }
+}
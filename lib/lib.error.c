@@ -22,6 +22,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <sched.h>
 #include <sys/time.h>
 
 /* Define va_copy macro if not available (ANSI C99 only).
@@ -52,23 +53,145 @@ int  loglevel     = LOG_DEBUG;
 FILE *stdlog      = NULL;
 int  syslog_open  = 0;
 
-char *printf_escape(const char *str)
+/* Log messages are not written out one by one, but collected in a
+ * preallocated buffer per destination that is written in batches: when
+ * it is full, when the previous write was more than LOG_FLUSH_USEC ago,
+ * for messages of level LOG_WARNING or more severe, and at exit. The
+ * date part of the timestamps is only formatted once per second. This
+ * keeps (debug) logging from the hot loops of runguard and runpipe cheap
+ * and free of allocations, so that it does not distort timings.
+ */
+#define LOG_BUFSIZE    32768
+#define LOG_MSGSIZE    2048
+#define LOG_FLUSH_USEC 100000
+
+struct logbuf {
+	char data[LOG_BUFSIZE];
+	size_t len;
+};
+
+static struct logbuf stderr_buf, stdlog_buf;
+
+/* Process that the buffered messages belong to: a forked child must not
+   write out the messages it inherited from its parent. */
+static pid_t logbuf_pid;
+
+static struct timeval last_flush;
+static int logflush_registered = 0;
+
+/* Protects the buffers against concurrent threads. Reentry from a signal
+   handler is detected per thread, and logged unbuffered. */
+static char logbuf_lock = 0;
+static __thread int in_vlogmsg = 0;
+
+static time_t timestring_sec = -1;
+static char timestring[64];
+
+static void write_all(int fd, const char *data, size_t len)
 {
-	char *escaped;
-	char c;
-	size_t str_pos, esc_pos;
+	ssize_t n;
 
-	escaped = (char *)malloc(2*strlen(str)+1);
-	esc_pos = 0;
+	while ( len>0 ) {
+		n = write(fd, data, len);
+		if ( n<0 ) {
+			if ( errno==EINTR ) continue;
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+}
 
-	for(str_pos=0; str_pos<strlen(str); str_pos++) {
-		c = str[str_pos];
-		escaped[esc_pos++] = c;
-		if ( c=='%' ) escaped[esc_pos++] = c;
+static void lock_logbuf()
+{
+	while ( __atomic_test_and_set(&logbuf_lock, __ATOMIC_ACQUIRE) ) sched_yield();
+}
+
+static void unlock_logbuf()
+{
+	__atomic_clear(&logbuf_lock, __ATOMIC_RELEASE);
+}
+
+/* Discard the messages of the parent in a forked child. */
+static void check_logbuf_pid(pid_t pid)
+{
+	if ( pid!=logbuf_pid ) {
+		stderr_buf.len = stdlog_buf.len = 0;
+		logbuf_pid = pid;
 	}
-	escaped[esc_pos] = 0;
+}
 
-	return escaped;
+static void flush_logbufs()
+{
+	if ( stderr_buf.len>0 ) {
+		write_all(fileno(stderr), stderr_buf.data, stderr_buf.len);
+		stderr_buf.len = 0;
+	}
+	if ( stdlog_buf.len>0 && stdlog!=NULL ) {
+		write_all(fileno(stdlog), stdlog_buf.data, stdlog_buf.len);
+		stdlog_buf.len = 0;
+	}
+}
+
+void logflush()
+{
+	lock_logbuf();
+	check_logbuf_pid(getpid());
+	flush_logbufs();
+	gettimeofday(&last_flush, NULL);
+	unlock_logbuf();
+}
+
+static void append_logbuf(struct logbuf *buf, const char *str, size_t len)
+{
+	if ( buf->len+len>LOG_BUFSIZE ) flush_logbufs();
+	memcpy(buf->data+buf->len, str, len);
+	buf->len += len;
+}
+
+/* Write a formatted message to stderr and/or the logfile, flushing the
+   buffers first if needed to keep them in order. */
+static void write_logmsg(const char *str, size_t len, int to_stderr, int to_stdlog, int urgent)
+{
+	struct timeval now;
+
+	if ( in_vlogmsg ) {
+		if ( to_stderr ) write_all(fileno(stderr), str, len);
+		if ( to_stdlog ) write_all(fileno(stdlog), str, len);
+		return;
+	}
+	in_vlogmsg = 1;
+	lock_logbuf();
+
+	check_logbuf_pid(getpid());
+	if ( !logflush_registered ) {
+		atexit(logflush);
+		logflush_registered = 1;
+	}
+
+	if ( len>LOG_BUFSIZE ) {
+		flush_logbufs();
+		if ( to_stderr ) write_all(fileno(stderr), str, len);
+		if ( to_stdlog ) write_all(fileno(stdlog), str, len);
+	} else {
+		if ( to_stderr ) append_logbuf(&stderr_buf, str, len);
+		if ( to_stdlog ) append_logbuf(&stdlog_buf, str, len);
+	}
+
+	gettimeofday(&now, NULL);
+	if ( urgent ||
+	     (now.tv_sec-last_flush.tv_sec)*1000000+(now.tv_usec-last_flush.tv_usec)>=LOG_FLUSH_USEC ) {
+		flush_logbufs();
+		last_flush = now;
+	}
+
+	unlock_logbuf();
+	in_vlogmsg = 0;
+}
+
+void logstderr(const char *str, size_t len, int urgent)
+{
+	write_logmsg(str, len, 1, 0, urgent);
 }
 
 /* Main function that contains logging code */
@@ -76,12 +199,14 @@ void vlogmsg(int msglevel, const char *mesg, va_list ap)
 {
 	struct timeval currtime;
 	struct tm tm_buf;
-	char timestring[128];
-	char *progname_escaped;
-	char *buffer;
-	int bufferlen;
+	char buffer[LOG_MSGSIZE];
+	char *longbuffer = NULL;
+	int headerlen, len;
+	int to_stderr, to_stdlog;
 	va_list aq;
 	char *str, *endptr;
+	char *msg = NULL;
+	int msglen = 0;
 	int syslog_fac;
 
 	/* This should never happen when called from any of the functions below. */
@@ -101,43 +226,66 @@ void vlogmsg(int msglevel, const char *mesg, va_list ap)
 		}
 	}
 
-	gettimeofday(&currtime, NULL);
-	localtime_r(&currtime.tv_sec, &tm_buf);
-	strftime(timestring, sizeof(timestring), "%b %d %H:%M:%S", &tm_buf);
-	sprintf(timestring+strlen(timestring), ".%03d", (int)(currtime.tv_usec/1000));
+	to_stderr = ( msglevel<=verbose );
+	to_stdlog = ( msglevel<=loglevel && stdlog!=NULL );
 
-	progname_escaped = printf_escape(progname);
-	if ( progname_escaped==NULL ) abort();
-
-	bufferlen = strlen(timestring)+strlen(progname_escaped)+strlen(mesg)+20;
-	buffer = (char *)malloc(bufferlen);
-	if ( buffer==NULL ) abort();
-
-	snprintf(buffer, bufferlen, "[%s] %s[%d]: %s\n",
-	         timestring, progname_escaped, getpid(), mesg);
+	if ( to_stderr || to_stdlog ) {
+		gettimeofday(&currtime, NULL);
+		if ( currtime.tv_sec!=timestring_sec ) {
+			localtime_r(&currtime.tv_sec, &tm_buf);
+			strftime(timestring, sizeof(timestring), "%b %d %H:%M:%S", &tm_buf);
+			timestring_sec = currtime.tv_sec;
+		}
 
-	free(progname_escaped);
+		headerlen = snprintf(buffer, sizeof(buffer), "[%s.%03d] %s[%d]: ",
+		                     timestring, (int)(currtime.tv_usec/1000),
+		                     progname, getpid());
+		if ( headerlen<0 || headerlen>=LOG_MSGSIZE ) headerlen = 0;
 
-	if ( msglevel<=verbose ) {
 		va_copy(aq, ap);
-		vfprintf(stderr, buffer, aq);
-		fflush(stderr);
+		len = vsnprintf(buffer+headerlen, sizeof(buffer)-headerlen, mesg, aq);
 		va_end(aq);
-	}
-	if ( msglevel<=loglevel && stdlog!=NULL ) {
-		va_copy(aq, ap);
-		vfprintf(stdlog, buffer, aq);
-		fflush(stdlog);
-		va_end(aq);
-	}
+		if ( len<0 ) len = 0;
+
+		/* Only messages that do not fit need an allocation. */
+		str = buffer;
+		if ( headerlen+len+1>=LOG_MSGSIZE ) {
+			longbuffer = (char *)malloc(headerlen+len+2);
+			if ( longbuffer==NULL ) abort();
+			memcpy(longbuffer, buffer, headerlen);
+			va_copy(aq, ap);
+			vsnprintf(longbuffer+headerlen, len+1, mesg, aq);
+			va_end(aq);
+			str = longbuffer;
+		}
+		msg = str+headerlen;
+		msglen = len;
+		len += headerlen;
+		str[len++] = '\n';
 
-	free(buffer);
+		write_logmsg(str, len, to_stderr, to_stdlog, msglevel<=LOG_WARNING);
+	}
 
+	/* Syslog gets the same untruncated message, without our header. */
 	if ( msglevel<=loglevel && syslog_open ) {
-		buffer = vallocstr(mesg, ap);
-		syslog(msglevel, "%s", buffer);
-		free(buffer);
+		if ( msg==NULL ) {
+			va_copy(aq, ap);
+			msglen = vsnprintf(buffer, sizeof(buffer), mesg, aq);
+			va_end(aq);
+			if ( msglen<0 ) msglen = 0;
+			msg = buffer;
+			if ( msglen>=LOG_MSGSIZE ) {
+				longbuffer = (char *)malloc(msglen+1);
+				if ( longbuffer==NULL ) abort();
+				va_copy(aq, ap);
+				vsnprintf(longbuffer, msglen+1, mesg, aq);
+				va_end(aq);
+				msg = longbuffer;
+			}
+		}
+		syslog(msglevel, "%.*s", msglen, msg);
 	}
+	free(longbuffer);
 }
 
 /* Argument-list wrapper function around vlogmsg */
@@ -151,6 +299,29 @@ void logmsg(int msglevel, const char *mesg, ...)
 	va_end(ap);
 }
 
+/* Write an error/warning string of the form
+       errtype . ": " . mesg . ": " . errdescr
+   to buffer, see errorstring below. Returns the length of the full
+   string, which is truncated if it does not fit.
+*/
+static int errorstring_r(char *buffer, size_t size, const char *type, int errnum, const char *mesg)
+{
+	const char *errdescr = NULL;
+
+	if ( type==NULL ) type = ERRSTR;
+
+	if ( errnum != 0 ) {
+		errdescr = strerror(errnum);
+	} else if ( mesg == NULL ) {
+		errdescr = "unknown error";
+	}
+
+	return snprintf(buffer, size, "%s: %s%s%s", type,
+	                mesg == NULL ? "" : mesg,
+	                mesg != NULL && errdescr != NULL ? ": " : "",
+	                errdescr == NULL ? "" : errdescr);
+}
+
 /* Function to generate error/warning string:
    - allocates memory for string (needs freeing later)
    - generates message of the form:
@@ -161,59 +332,40 @@ void logmsg(int msglevel, const char *mesg, ...)
 */
 char *errorstring(const char *type, int errnum, const char *mesg)
 {
-	size_t buffersize;
-	char *errtype, *errdescr, *buffer;
-
-	/* Set errtype to given string or default to 'ERROR' */
-	if ( type==NULL ) {
-		errtype = strdup(ERRSTR);
-		if ( errtype==NULL ) abort();
-	} else {
-		errtype = (char *)type;
-	}
-
-	errdescr = NULL;
-	if ( errnum != 0 ) {
-		errdescr = strerror(errno);
-	} else if ( mesg == NULL ) {
-		errdescr = strdup("unknown error");
-	}
+	int len;
+	char *buffer;
 
-	buffersize = strlen(errtype)
-	            + (errdescr == NULL ? 0 : strlen(errdescr))
-	            + (mesg == NULL     ? 0 : strlen(mesg))
-	            + 5;
+	len = errorstring_r(NULL, 0, type, errnum, mesg);
 
-	buffer = (char *)malloc(sizeof(char) * buffersize);
+	buffer = (char *)malloc(len+1);
 	if ( buffer==NULL ) abort();
-	buffer[0] = '\0';
 
-	strcat(buffer, errtype);
-	strcat(buffer, ": ");
+	errorstring_r(buffer, len+1, type, errnum, mesg);
 
-	if ( mesg != NULL )     strcat(buffer, mesg);
+	return buffer;
+}
 
-	if ( mesg != NULL &&
-	     errdescr != NULL ) strcat(buffer, ": ");
+/* Log an error/warning message of the given type and level, without
+   allocating memory for the common case of short messages. */
+static void vlogtyped(int msglevel, const char *type, int errnum, const char *mesg, va_list ap)
+{
+	char buffer[LOG_MSGSIZE];
+	char *str;
 
-	if ( errdescr != NULL )	strcat(buffer, errdescr);
+	str = buffer;
+	if ( errorstring_r(buffer, sizeof(buffer), type, errnum, mesg)>=LOG_MSGSIZE ) {
+		str = errorstring(type, errnum, mesg);
+	}
 
-	if ( type == NULL ) free(errtype);
-	if ( mesg == NULL && errnum == 0 ) free(errdescr);
+	vlogmsg(msglevel, str, ap);
 
-	return buffer;
+	if ( str!=buffer ) free(str);
 }
 
 /* Function to generate and write error logmessage (using vlogmsg) */
 void vlogerror(int errnum, const char *mesg, va_list ap)
 {
-	char *buffer;
-
-	buffer = errorstring(ERRSTR, errnum, mesg);
-
-	vlogmsg(LOG_ERR, buffer, ap);
-
-	free(buffer);
+	vlogtyped(LOG_ERR, ERRSTR, errnum, mesg, ap);
 }
 
 /* Argument-list wrapper function around vlogerror */
@@ -249,13 +401,7 @@ void error(int errnum, const char *mesg, ...)
 /* Logs a warning message */
 void vwarning(int errnum, const char *mesg, va_list ap)
 {
-	char *buffer;
-
-	buffer = errorstring(WARNSTR, errnum, mesg);
-
-	vlogmsg(LOG_WARNING, buffer, ap);
-
-	free(buffer);
+	vlogtyped(LOG_WARNING, WARNSTR, errnum, mesg, ap);
 }
 
 /* Argument-list wrapper function around vwarning */
@@ -46,6 +46,16 @@ void vlogmsg(int, const char *, va_list);
  * ... or va_list  optional arguments for format characters
  */
 
+void logflush(void);
+void logstderr(const char *, size_t, int);
+/* Log messages are buffered and written out in batches, see lib.error.c.
+ * logflush   writes out all buffered messages, e.g. before a fork+exec
+ *            or a redirection of stderr; it is also called at exit.
+ * logstderr  writes a preformatted string of the given length to stderr
+ *            through the same buffer; with non-zero 'urgent' the buffer
+ *            is written out immediately.
+ */
+
 char *errorstring(const char *, int, const char *);
 /* Error string generating function:
  * Returns a pointer to a dynamically allocated string containing the error
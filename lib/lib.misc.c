@@ -14,6 +14,7 @@
 #include <signal.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <spawn.h>
 
 #include "lib.misc.h"
 #include "lib.error.h"
@@ -22,6 +23,8 @@
 #define PIPE_IN  1
 #define PIPE_OUT 0
 
+extern char **environ;
+
 const int def_stdio_fd[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
 
 void _alert(const char *libdir, const char *msgtype, const char *description)
@@ -45,6 +48,15 @@ void _alert(const char *libdir, const char *msgtype, const char *description)
 	free(cmd);
 }
 
+/* Add file actions to make fd the file descriptor target of the child,
+   closing the original. */
+static int spawn_redirect(posix_spawn_file_actions_t *actions, int fd, int target)
+{
+	if ( fd==target ) return 0;
+	if ( posix_spawn_file_actions_adddup2(actions, fd, target)!=0 ) return -1;
+	return posix_spawn_file_actions_addclose(actions, fd);
+}
+
 int execute(const char *cmd, const char **args, int nargs, int stdio_fd[3], int err2out)
 {
 	pid_t pid, child_pid;
@@ -52,7 +64,8 @@ int execute(const char *cmd, const char **args, int nargs, int stdio_fd[3], int
 	int status;
 	int pipe_fd[3][2];
 	char **argv;
-	int i, dir;
+	int i, dir, ret;
+	posix_spawn_file_actions_t actions;
 
 	if ( (argv=(char **) malloc((nargs+2)*sizeof(char *)))==NULL ) return -1;
 
@@ -62,84 +75,95 @@ int execute(const char *cmd, const char **args, int nargs, int stdio_fd[3], int
 	             stdio_fd[1]!=FDREDIR_NONE ||
 	             stdio_fd[2]!=FDREDIR_NONE );
 
-	/* Build the complete argument list for execvp.
-	 * We can const-cast the pointers, since execvp is guaranteed
+	/* Build the complete argument list for posix_spawnp.
+	 * We can const-cast the pointers, since posix_spawnp is guaranteed
 	 * not to modify these (or the data pointed to).
 	 */
 	argv[0] = (char *) cmd;
 	for(i=0; i<nargs; i++) argv[i+1] = (char *) args[i];
 	argv[nargs+1] = NULL;
 
+	if ( posix_spawn_file_actions_init(&actions)!=0 ) {
+		free(argv);
+		return -1;
+	}
+
 	/* Open pipes for IO redirection */
+	for(i=0; i<3; i++) pipe_fd[i][0] = pipe_fd[i][1] = -1;
 	for(i=0; i<3; i++) {
 		if ( stdio_fd[i]==FDREDIR_PIPE && pipe(pipe_fd[i])!=0 ) goto ret_error;
 	}
 
-	switch ( child_pid = fork() ) {
-	case -1: /* error */
-		free(argv);
-		return -1;
-
-	case  0: /* child process */
-		/* Connect pipes to command stdin/stdout/stderr and close unneeded fd's */
-		for(i=0; i<3; i++) {
-			if ( stdio_fd[i]==FDREDIR_PIPE ) {
-				/* stdin must be connected to the pipe output,
-				   stdout/stderr to the pipe input: */
-				dir = (i==0 ? PIPE_OUT : PIPE_IN);
-				if ( dup2(pipe_fd[i][dir],def_stdio_fd[i])<0 ) goto ret_error;
-				if ( close(pipe_fd[i][dir])!=0 ) goto ret_error;
-				if ( close(pipe_fd[i][1-dir])!=0 ) goto ret_error;
-			}
-			if ( stdio_fd[i]>=0 ) {
-				if ( dup2(stdio_fd[i],def_stdio_fd[i])<0 ) goto ret_error;
-				if ( close(stdio_fd[i])!=0 ) goto ret_error;
+	/* Connect pipes to command stdin/stdout/stderr and close unneeded
+	   fd's in the child */
+	for(i=0; i<3; i++) {
+		if ( stdio_fd[i]==FDREDIR_PIPE ) {
+			/* stdin must be connected to the pipe output,
+			   stdout/stderr to the pipe input: */
+			dir = (i==0 ? PIPE_OUT : PIPE_IN);
+			if ( spawn_redirect(&actions, pipe_fd[i][dir], def_stdio_fd[i])!=0 ||
+			     posix_spawn_file_actions_addclose(&actions, pipe_fd[i][1-dir])!=0 ) {
+				goto ret_error;
 			}
 		}
-		/* Redirect stderr to stdout */
-		if ( err2out && dup2(STDOUT_FILENO,STDERR_FILENO)<0 ) goto ret_error;
-
-		/* Replace child with command */
-		execvp(cmd,argv);
-		abort();
+		if ( stdio_fd[i]>=0 ) {
+			if ( spawn_redirect(&actions, stdio_fd[i], def_stdio_fd[i])!=0 ) goto ret_error;
+		}
+	}
+	/* Redirect stderr to stdout */
+	if ( err2out &&
+	     posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO)!=0 ) {
+		goto ret_error;
+	}
 
-	default: /* parent process */
+	/* Unlike fork, posix_spawn does not copy the address space of this
+	   process, so starting the command does not become slower with its
+	   size. Failure to execute the command is reported here. */
+	ret = posix_spawnp(&child_pid, cmd, &actions, NULL, argv, environ);
+	if ( ret!=0 ) {
+		errno = ret;
+		goto ret_error;
+	}
 
-		free(argv);
+	posix_spawn_file_actions_destroy(&actions);
+	free(argv);
 
-		/* Set and close file descriptors */
-		for(i=0; i<3; i++) {
-			if ( stdio_fd[i]==FDREDIR_PIPE ) {
-				/* parent process output must connect to the input of
-				   the pipe to child, and vice versa for stdout/stderr: */
-				dir = (i==0 ? PIPE_IN : PIPE_OUT);
-				stdio_fd[i] = pipe_fd[i][dir];
-				if ( close(pipe_fd[i][1-dir])!=0 ) return -1;
-			}
+	/* Set and close file descriptors */
+	for(i=0; i<3; i++) {
+		if ( stdio_fd[i]==FDREDIR_PIPE ) {
+			/* parent process output must connect to the input of
+			   the pipe to child, and vice versa for stdout/stderr: */
+			dir = (i==0 ? PIPE_IN : PIPE_OUT);
+			stdio_fd[i] = pipe_fd[i][dir];
+			if ( close(pipe_fd[i][1-dir])!=0 ) return -1;
 		}
+	}
 
-		/* Return if some IO is redirected to be able to read/write to child */
-		if ( redirect ) return child_pid;
+	/* Return if some IO is redirected to be able to read/write to child */
+	if ( redirect ) return child_pid;
 
-		/* Wait for the child command to finish */
-		while ( (pid = wait(&status))!=-1 && pid!=child_pid );
-		if ( pid!=child_pid ) return -1;
+	/* Wait for the child command to finish */
+	while ( (pid = wait(&status))!=-1 && pid!=child_pid );
+	if ( pid!=child_pid ) return -1;
 
-		/* Test whether command has finished abnormally */
-		if ( ! WIFEXITED(status) ) {
-			if ( WIFSIGNALED(status) ) return 128+WTERMSIG(status);
-			if ( WIFSTOPPED (status) ) return 128+WSTOPSIG(status);
-			return -2;
-		}
-		return WEXITSTATUS(status);
+	/* Test whether command has finished abnormally */
+	if ( ! WIFEXITED(status) ) {
+		if ( WIFSIGNALED(status) ) return 128+WTERMSIG(status);
+		if ( WIFSTOPPED (status) ) return 128+WSTOPSIG(status);
+		return -2;
 	}
-
-	/* This should never be reached */
-	return -2;
+	return WEXITSTATUS(status);
 
 	/* Handle resources before returning on error */
   ret_error:
+	ret = errno;
+	for(i=0; i<3; i++) {
+		if ( pipe_fd[i][0]>=0 ) close(pipe_fd[i][0]);
+		if ( pipe_fd[i][1]>=0 ) close(pipe_fd[i][1]);
+	}
+	posix_spawn_file_actions_destroy(&actions);
 	free(argv);
+	errno = ret;
 	return -1;
 }
 
@@ -197,6 +221,9 @@ void daemonize(const char *_pidfile)
 	int fd, maxfd;
 	char str[15];
 
+	/* The parent exits without flushing buffered log messages. */
+	logflush();
+
 	switch ( pid = fork() ) {
 	case -1: error(errno, "cannot fork daemon");
 	case  0: break;     /* child process: do nothing here. */
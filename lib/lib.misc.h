@@ -25,8 +25,9 @@ void _alert(const char *libdir, const char *msgtype, const char *description)
 
 int execute(const char *, const char **, int, int[3], int)
     __attribute__((nonnull (1, 2)));
-/* Execute a subprocess using fork and execvp and optionally perform
- * IO redirection of stdin/stdout/stderr.
+/* Execute a subprocess using posix_spawnp and optionally perform
+ * IO redirection of stdin/stdout/stderr. The cost of starting the
+ * command does not depend on the size of the calling process.
  *
  * Arguments:
  * char *cmd        command to be executed (PATH is searched)
@@ -43,6 +44,7 @@ int execute(const char *, const char **, int, int[3], int)
  *
  * Returns:
  * On errors from system calls -1 is returned: check errno for extra information.
+ * This includes failure to execute the command itself.
  * On internal errors -2 is returned.
  *
  * When no redirection is done (except for err2out) waits for the command to
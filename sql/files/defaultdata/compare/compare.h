@@ -0,0 +1,1148 @@
+// default_validator from kattis problemtools package
+// licensed under MIT license
+//
+// modified: float comparison, memory mapped input, vectorized scanning
+//
+// The comparison itself, used by compare.cc and by the judgehost's native
+// default_compare, which runs it without a separate sandbox. Include it
+// in a single translation unit only.
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+#include <cstdarg>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const int EXIT_AC = 42;
+const int EXIT_WA = 43;
+
+std::ifstream judgein;
+FILE *judgemessage = NULL;
+FILE *diffpos = NULL;
+int judgeans_pos, stdin_pos;
+int judgeans_line, stdin_line;
+
+/* The floating point type we use internally: */
+typedef long double flt;
+
+void wrong_answer(const char *err, ...) {
+	va_list pvar;
+	va_start(pvar, err);
+	fprintf(judgemessage, "Wrong answer on line %d of output (corresponding to line %d in answer file)\n",
+			stdin_line, judgeans_line);
+	vfprintf(judgemessage, err, pvar);
+	fprintf(judgemessage, "\n");
+	if (diffpos) {
+		fprintf(diffpos, "%d %d", judgeans_pos, stdin_pos);
+	}
+	exit(EXIT_WA);
+}
+
+void judge_error(const char *err, ...) {
+	va_list pvar;
+	va_start(pvar, err);
+	// If judgemessage hasn't been set up yet, write error to stderr
+	if (!judgemessage) judgemessage = stderr;
+	vfprintf(judgemessage, err, pvar);
+	fprintf(judgemessage, "\n");
+	assert(!"Judge Error");
+}
+
+bool isfloat(const char *s, flt &val) {
+	char trash[20];
+	flt v;
+	if (sscanf(s, "%Lf%10s", &v, trash) != 1) return false;
+	val = v;
+	return true;
+}
+
+/* Fast path for the common plain decimal floats, such as "-12.345e-6".
+ * When both the significant digits and the power of ten are exactly
+ * representable, a single multiplication or division gives the correctly
+ * rounded value, the same that scanf returns. Returns false for anything
+ * else, including valid floats that do not satisfy these conditions.
+ */
+const int MAX_EXACT_POW10 = std::numeric_limits<flt>::digits >= 64 ? 27 : 22;
+const uint64_t MAX_EXACT_INT = std::numeric_limits<flt>::digits >= 64 ?
+	UINT64_MAX : (uint64_t(1) << std::numeric_limits<flt>::digits);
+
+bool parse_decimal(std::string_view s, flt &val) {
+	static const struct pow10_table {
+		flt p[MAX_EXACT_POW10+1];
+		pow10_table() {
+			p[0] = 1;
+			for (int i = 1; i <= MAX_EXACT_POW10; i++) p[i] = p[i-1] * 10;
+		}
+	} pow10;
+
+	const char *p = s.data(), *end = p + s.size();
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	uint64_t mantissa = 0;
+	int exp10 = 0, ndigits = 0;
+	for (; p < end && isdigit(static_cast<unsigned char>(*p)); p++, ndigits++) {
+		if (mantissa > (UINT64_MAX - 9) / 10) return false;
+		mantissa = 10*mantissa + (*p - '0');
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && isdigit(static_cast<unsigned char>(*p)); p++, ndigits++) {
+			if (mantissa > (UINT64_MAX - 9) / 10) return false;
+			mantissa = 10*mantissa + (*p - '0');
+			exp10--;
+		}
+	}
+	if (ndigits == 0) return false;
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		int exp_sign = 1, exp = 0;
+		if (p < end && (*p == '-' || *p == '+')) exp_sign = *p++ == '-' ? -1 : 1;
+		auto res = std::from_chars(p, end, exp);
+		if (res.ec != std::errc() || res.ptr == p || *p == '-') return false;
+		p = res.ptr;
+		if (exp > 1000) return false;
+		exp10 += exp_sign * exp;
+	}
+	if (p != end) return false;
+
+	if (mantissa > MAX_EXACT_INT) return false;
+	flt v = mantissa;
+	if (exp10 < 0) {
+		if (exp10 < -MAX_EXACT_POW10) return false;
+		v /= pow10.p[-exp10];
+	} else {
+		if (exp10 > MAX_EXACT_POW10) return false;
+		v *= pow10.p[exp10];
+	}
+	val = negative ? -v : v;
+	return true;
+}
+
+bool isfloat(std::string_view s, flt &val) {
+	if (parse_decimal(s, val)) return true;
+	// Only copy long tokens to the heap for the null terminator.
+	char buf[64];
+	if (s.size() < sizeof(buf)) {
+		memcpy(buf, s.data(), s.size());
+		buf[s.size()] = '\0';
+		return isfloat(buf, val);
+	}
+	return isfloat(std::string(s).c_str(), val);
+}
+
+// Tokens are views into the input buffers; only copy them for messages.
+std::string str(std::string_view s) {
+	return std::string(s);
+}
+
+/* The contents of an input: memory mapped if it is a regular file,
+ * otherwise read into a buffer with large reads. Such a stream is read
+ * incrementally with read_more(), so that comparing can start while the
+ * output is still being written, and what has been compared is dropped
+ * with discard(). Reading more may move data.
+ */
+struct input_buffer {
+	const char *data = NULL;
+	size_t size = 0;
+	std::string buffer;
+	// The offset in the input of data, after discarding a stream prefix.
+	size_t offset = 0;
+	// The stream that is still being read, if any.
+	int stream_fd = -1;
+	const char *stream_file = NULL, *stream_whoami = NULL;
+
+	void read_fd(int fd, const char *file, const char *whoami) {
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			judge_error("%s: failed to stat %s: %s", whoami, file, strerror(errno));
+		}
+		if (S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) == 0) {
+			size = st.st_size;
+			if (size == 0) return;
+			void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED) {
+				madvise(map, size, MADV_SEQUENTIAL);
+				data = static_cast<const char *>(map);
+				return;
+			}
+		}
+
+		stream_fd = fd;
+		stream_file = file;
+		stream_whoami = whoami;
+		data = buffer.data();
+	}
+
+	// Whether all of the input has been read.
+	bool complete() const { return stream_fd < 0; }
+
+	// Drop the buffered stream data before input offset keep, once that
+	// is at least half of it, so that a long stream is not kept whole.
+	void discard(size_t keep) {
+		size_t n = keep - offset;
+		if (stream_fd < 0 || n == 0 || n < size/2) return;
+		memmove(&buffer[0], &buffer[n], size - n);
+		size -= n;
+		offset += n;
+	}
+
+	// Append the next data from the stream. Returns false at its end.
+	bool read_more() {
+		if (stream_fd < 0) return false;
+		const size_t chunk = 1 << 20;
+		if (buffer.size() < size + chunk) buffer.resize(2*buffer.size() + chunk);
+		while (true) {
+			ssize_t nread = read(stream_fd, &buffer[size], buffer.size() - size);
+			if (nread < 0) {
+				if (errno == EINTR) continue;
+				judge_error("%s: failed to read %s: %s", stream_whoami, stream_file, strerror(errno));
+			}
+			data = buffer.data();
+			if (nread == 0) {
+				stream_fd = -1;
+				return false;
+			}
+			size += nread;
+			return true;
+		}
+	}
+
+	void open_file(const char *file, const char *whoami) {
+		int fd = open(file, O_RDONLY);
+		if (fd < 0) {
+			judge_error("%s: failed to open %s\n", whoami, file);
+		}
+		read_fd(fd, file, whoami);
+		while (read_more()) {}
+		close(fd);
+	}
+};
+
+/* Vectorized scanning over the input buffers. The whitespace characters
+ * are those of std::isspace in the C locale: space and '\t' to '\r'.
+ * Blocks of BLOCK bytes are classified at once with AVX2 or SSE2 when the
+ * compiler targets them, the remainder is scanned with scalar code.
+ */
+inline bool is_space(char c) {
+	unsigned char u = static_cast<unsigned char>(c);
+	return u == ' ' || static_cast<unsigned char>(u - '\t') <= '\r' - '\t';
+}
+
+#if defined(__AVX2__)
+const size_t BLOCK = 32;
+typedef uint32_t block_mask;
+
+inline block_mask space_mask(const char *p) {
+	__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+	__m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+	__m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8('\r' - '\t')), t);
+	__m256i sp = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+	return _mm256_movemask_epi8(_mm256_or_si256(sp, ctl));
+}
+
+inline block_mask equal_mask(const char *p, const char *q) {
+	__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+	__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q));
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+}
+
+inline block_mask newline_mask(const char *p) {
+	__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+}
+#elif defined(__SSE2__)
+const size_t BLOCK = 16;
+typedef uint32_t block_mask;
+
+inline block_mask space_mask(const char *p) {
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+	__m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+	__m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8('\r' - '\t')), t);
+	__m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+	return _mm_movemask_epi8(_mm_or_si128(sp, ctl));
+}
+
+inline block_mask equal_mask(const char *p, const char *q) {
+	__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+	__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(q));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+
+inline block_mask newline_mask(const char *p) {
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+#else
+const size_t BLOCK = 8;
+typedef uint32_t block_mask;
+
+inline block_mask space_mask(const char *p) {
+	block_mask m = 0;
+	for (size_t i = 0; i < BLOCK; i++) m |= block_mask(is_space(p[i])) << i;
+	return m;
+}
+
+inline block_mask equal_mask(const char *p, const char *q) {
+	block_mask m = 0;
+	for (size_t i = 0; i < BLOCK; i++) m |= block_mask(p[i] == q[i]) << i;
+	return m;
+}
+
+inline block_mask newline_mask(const char *p) {
+	block_mask m = 0;
+	for (size_t i = 0; i < BLOCK; i++) m |= block_mask(p[i] == '\n') << i;
+	return m;
+}
+#endif
+
+const block_mask FULL_MASK = block_mask(~0ULL >> (64 - BLOCK));
+
+// Find the first character in [p,end) that is (not) whitespace.
+template <bool space>
+const char *find_class(const char *p, const char *end) {
+	// Runs are mostly short, so first check a few characters directly.
+	for (int i = 0; i < 4; i++, p++) {
+		if (p == end || is_space(*p) == space) return p;
+	}
+	for (; end - p >= (ptrdiff_t)BLOCK; p += BLOCK) {
+		block_mask m = space_mask(p);
+		if (!space) m = ~m & FULL_MASK;
+		if (m) return p + __builtin_ctz(m);
+	}
+	while (p < end && is_space(*p) != space) p++;
+	return p;
+}
+
+inline const char *skip_space(const char *p, const char *end) { return find_class<false>(p, end); }
+inline const char *skip_token(const char *p, const char *end) { return find_class<true>(p, end); }
+
+int count_newlines(const char *p, const char *end) {
+	int count = 0;
+	for (; end - p >= (ptrdiff_t)BLOCK; p += BLOCK) {
+		count += __builtin_popcount(newline_mask(p));
+	}
+	for (; p < end; p++) count += *p == '\n';
+	return count;
+}
+
+// Length of the common prefix of a and b, both of length n.
+size_t common_prefix(const char *a, const char *b, size_t n) {
+	// Skip large identical parts with (vectorized) memcmp first.
+	const size_t chunk = 4096;
+	size_t i = 0;
+	while (i + chunk <= n && memcmp(a + i, b + i, chunk) == 0) i += chunk;
+	for (; i + BLOCK <= n; i += BLOCK) {
+		block_mask m = ~equal_mask(a + i, b + i) & FULL_MASK;
+		if (m) return i + __builtin_ctz(m);
+	}
+	while (i < n && a[i] == b[i]) i++;
+	return i;
+}
+
+/* Index of the tokens in the judge answer, and of which of them are
+ * floats, so that the answer need not be tokenized and classified again
+ * for every submission. It is built by a run that finds an empty,
+ * writable file <judge_ans>.idx, which judge-runner then caches next to
+ * the testcase, and memory mapped from that file on later runs.
+ *
+ * The tokens are grouped in blocks of 64. Each block stores the offset
+ * of its first token and bitmaps of its tokens that are not floats and
+ * of those whose value is stored, and each token its offset within the
+ * block and its length in 16 bits. A block that spans more than that,
+ * or has a longer token, stores them in 64 bits in a separate list of
+ * wide tokens instead. Values are only stored for floats that
+ * parse_decimal() cannot parse quickly. So the index takes a bit over 4
+ * bytes per token, which is smaller than the answer unless its tokens
+ * are very short.
+ *
+ * The file consists of an index_header, the index_block entries, ntokens
+ * index_token entries, nwide index_wide_token entries and nvalues flt
+ * values.
+ */
+const char INDEX_MAGIC[8] = {'D', 'J', 'C', 'M', 'P', 'I', 'D', 'X'};
+const uint32_t INDEX_VERSION = 3;
+const size_t INDEX_MIN_SIZE = 1 << 20;
+const size_t INDEX_BLOCK = 64;
+// The first_wide of a block whose tokens fit in 16 bits.
+const uint64_t INDEX_NARROW = UINT64_MAX;
+
+struct index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flt_size;
+	uint64_t answer_size;
+	uint64_t ntokens;
+	uint64_t nvalues;
+	uint64_t nwide;
+};
+
+struct index_block {
+	uint64_t offset;
+	uint64_t string_bits;
+	uint64_t value_bits;
+	uint64_t first_value;
+	uint64_t first_wide;
+};
+
+struct index_token {
+	uint16_t offset;
+	uint16_t length;
+};
+
+struct index_wide_token {
+	uint64_t offset;
+	uint64_t length;
+};
+
+struct answer_index {
+	const index_block *blocks = NULL;
+	const index_token *tokens = NULL;
+	const index_wide_token *wide = NULL;
+	const flt *values = NULL;
+	size_t ntokens = 0;
+
+	static size_t align(size_t off, size_t a) { return (off + a - 1) / a * a; }
+	static size_t nblocks(size_t n) { return (n + INDEX_BLOCK - 1) / INDEX_BLOCK; }
+	static size_t tokens_offset(size_t n) { return sizeof(index_header) + nblocks(n)*sizeof(index_block); }
+	static size_t wide_offset(size_t n) {
+		return align(tokens_offset(n) + n*sizeof(index_token), alignof(index_wide_token));
+	}
+	static size_t values_offset(size_t n, size_t nwide) {
+		return align(wide_offset(n) + nwide*sizeof(index_wide_token), alignof(flt));
+	}
+	static size_t file_size(size_t n, size_t nwide, size_t nvalues) {
+		return values_offset(n, nwide) + nvalues*sizeof(flt);
+	}
+
+	// Use the index in data, if it is a valid index for the answer.
+	bool attach(const char *data, size_t size, size_t answer_size) {
+		index_header hdr;
+		if (size < sizeof(hdr)) return false;
+		memcpy(&hdr, data, sizeof(hdr));
+		if (memcmp(hdr.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+		    hdr.version != INDEX_VERSION || hdr.flt_size != sizeof(flt) ||
+		    hdr.answer_size != answer_size ||
+		    hdr.ntokens > size / sizeof(index_token) || hdr.nvalues > size / sizeof(flt) ||
+		    hdr.nwide > size / sizeof(index_wide_token) ||
+		    size != file_size(hdr.ntokens, hdr.nwide, hdr.nvalues)) {
+			return false;
+		}
+		blocks = reinterpret_cast<const index_block *>(data + sizeof(hdr));
+		tokens = reinterpret_cast<const index_token *>(data + tokens_offset(hdr.ntokens));
+		wide = reinterpret_cast<const index_wide_token *>(data + wide_offset(hdr.ntokens));
+		ntokens = hdr.ntokens;
+		uint64_t nvalues = 0, nwide = 0;
+		for (size_t b = 0; b < nblocks(ntokens); b++) {
+			const index_block &blk = blocks[b];
+			size_t n = std::min(INDEX_BLOCK, ntokens - b*INDEX_BLOCK);
+			uint64_t used = n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+			if ((blk.string_bits & blk.value_bits) || ((blk.string_bits | blk.value_bits) & ~used) ||
+			    blk.first_value != nvalues ||
+			    (blk.first_wide != INDEX_NARROW && blk.first_wide != nwide)) {
+				return false;
+			}
+			nvalues += __builtin_popcountll(blk.value_bits);
+			if (blk.first_wide != INDEX_NARROW) nwide += n;
+		}
+		if (nvalues != hdr.nvalues || nwide != hdr.nwide) return false;
+		for (size_t i = 0; i < ntokens; i++) {
+			if (token_offset(i) > answer_size || token_length(i) > answer_size - token_offset(i) ||
+			    (i > 0 && token_offset(i) <= token_offset(i-1) + token_length(i-1))) {
+				return false;
+			}
+		}
+		values = reinterpret_cast<const flt *>(data + values_offset(hdr.ntokens, hdr.nwide));
+		return true;
+	}
+
+	uint64_t token_offset(size_t i) const {
+		const index_block &blk = blocks[i / INDEX_BLOCK];
+		if (blk.first_wide != INDEX_NARROW) return blk.offset + wide[blk.first_wide + i % INDEX_BLOCK].offset;
+		return blk.offset + tokens[i].offset;
+	}
+	size_t token_length(size_t i) const {
+		const index_block &blk = blocks[i / INDEX_BLOCK];
+		if (blk.first_wide != INDEX_NARROW) return wide[blk.first_wide + i % INDEX_BLOCK].length;
+		return tokens[i].length;
+	}
+
+	// Parse token i, which is token, as float.
+	bool token_float(size_t i, std::string_view token, flt &val) const {
+		const index_block &blk = blocks[i / INDEX_BLOCK];
+		uint64_t bit = uint64_t(1) << (i % INDEX_BLOCK);
+		if (blk.string_bits & bit) return false;
+		if (blk.value_bits & bit) {
+			val = values[blk.first_value + __builtin_popcountll(blk.value_bits & (bit - 1))];
+			return true;
+		}
+		return parse_decimal(token, val);
+	}
+
+	// The first token at or after offset.
+	size_t first_token_at(uint64_t offset) const {
+		size_t lo = 0, hi = ntokens;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (token_offset(mid) < offset) lo = mid + 1;
+			else hi = mid;
+		}
+		return lo;
+	}
+};
+
+// Build the index file contents for answer.
+std::string build_index(const input_buffer &answer) {
+	std::vector<index_block> blocks;
+	std::vector<index_token> toks;
+	std::vector<index_wide_token> wide, block_toks;
+	std::vector<flt> vals;
+
+	// Store the tokens of the last block in 16 bits if they fit.
+	auto finish_block = [&]() {
+		index_block &blk = blocks.back();
+		bool narrow = true;
+		for (const index_wide_token &t : block_toks) {
+			if (t.offset > UINT16_MAX || t.length > UINT16_MAX) narrow = false;
+		}
+		if (!narrow) blk.first_wide = wide.size();
+		for (const index_wide_token &t : block_toks) {
+			if (narrow) {
+				toks.push_back({(uint16_t)t.offset, (uint16_t)t.length});
+			} else {
+				toks.push_back({0, 0});
+				wide.push_back(t);
+			}
+		}
+		block_toks.clear();
+	};
+
+	const char *p = answer.data, *end = answer.data + answer.size;
+	size_t i = 0;
+	while (true) {
+		const char *q = skip_space(p, end);
+		if (q == end) break;
+		p = skip_token(q, end);
+		uint64_t offset = q - answer.data;
+		if (i % INDEX_BLOCK == 0) {
+			if (i > 0) finish_block();
+			blocks.push_back({offset, 0, 0, vals.size(), INDEX_NARROW});
+		}
+		index_block &blk = blocks.back();
+
+		std::string_view token(q, p - q);
+		uint64_t bit = uint64_t(1) << (i % INDEX_BLOCK);
+		flt v;
+		if (parse_decimal(token, v)) {
+			// Cheap enough to parse again when comparing.
+		} else if (isfloat(token, v)) {
+			blk.value_bits |= bit;
+			vals.push_back(v);
+		} else {
+			blk.string_bits |= bit;
+		}
+		block_toks.push_back({offset - blk.offset, (uint64_t)(p - q)});
+		i++;
+	}
+	if (i > 0) finish_block();
+
+	size_t n = toks.size();
+	index_header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	hdr.version = INDEX_VERSION;
+	hdr.flt_size = sizeof(flt);
+	hdr.answer_size = answer.size;
+	hdr.ntokens = n;
+	hdr.nvalues = vals.size();
+	hdr.nwide = wide.size();
+
+	std::string image(answer_index::file_size(n, wide.size(), vals.size()), '\0');
+	memcpy(&image[0], &hdr, sizeof(hdr));
+	memcpy(&image[sizeof(hdr)], blocks.data(), blocks.size()*sizeof(index_block));
+	memcpy(&image[answer_index::tokens_offset(n)], toks.data(), n*sizeof(index_token));
+	memcpy(&image[answer_index::wide_offset(n)], wide.data(), wide.size()*sizeof(index_wide_token));
+	memcpy(&image[answer_index::values_offset(n, wide.size())], vals.data(), vals.size()*sizeof(flt));
+	return image;
+}
+
+/* Set up the index for the judge answer from <judge_ans>.idx: map it if
+ * it is not empty, otherwise try to build it and write it there.
+ */
+bool setup_index(answer_index &index, std::string &image, const input_buffer &answer, const char *judgeans_file) {
+	std::string path = std::string(judgeans_file) + ".idx";
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+	if (st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED) return false;
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		return index.attach(static_cast<const char *>(map), st.st_size, answer.size);
+	}
+	close(fd);
+
+	if (answer.size < INDEX_MIN_SIZE || (fd = open(path.c_str(), O_WRONLY)) < 0) return false;
+	image = build_index(answer);
+	for (size_t done = 0; done < image.size(); ) {
+		ssize_t nwritten = write(fd, image.data() + done, image.size() - done);
+		if (nwritten < 0 && errno == EINTR) continue;
+		if (nwritten <= 0) {
+			// Do not leave a partial index to be cached.
+			if (ftruncate(fd, 0) != 0) {}
+			break;
+		}
+		done += nwritten;
+	}
+	close(fd);
+	return index.attach(image.data(), image.size(), answer.size);
+}
+
+/* Reads whitespace separated tokens from an input buffer. Tokens and
+ * pointers into the input stay valid until more of a stream is read,
+ * which drops the stream data before the current position.
+ */
+struct tokenizer {
+	const char *begin, *cur, *end;
+	// The offset in the input of begin.
+	size_t base;
+	// The token index of the input if available, and the next token in it.
+	// It is only used when whitespace changes are ignored.
+	const answer_index *index = NULL;
+	size_t next = 0;
+	// The input if it is a stream that is still being read.
+	input_buffer *source = NULL;
+
+	explicit tokenizer(input_buffer &input)
+		: begin(input.data), cur(input.data), end(input.data + input.size), base(input.offset) {
+		if (!input.complete()) source = &input;
+	}
+
+	void seek(const char *p) {
+		cur = p;
+		if (index) next = index->first_token_at(p - begin);
+	}
+
+	// Read more of the input, keeping what is buffered from input offset
+	// keep on. Returns false if there is no more.
+	bool refill(size_t keep) {
+		if (source == NULL) return false;
+		size_t offset = base + (cur - begin);
+		source->discard(keep);
+		bool more = source->read_more();
+		base = source->offset;
+		begin = source->data;
+		cur = begin + (offset - base);
+		end = begin + source->size;
+		if (source->complete()) source = NULL;
+		return more;
+	}
+
+	bool refill() { return refill(base + (cur - begin)); }
+
+	// Make at least n characters available if the input has them.
+	void ensure(size_t n) {
+		while ((size_t)(end - cur) < n && refill()) {}
+	}
+
+	bool at_end() {
+		while (cur == end) {
+			if (!refill()) return true;
+		}
+		return false;
+	}
+
+	// The next character, or EOF at the end of the input.
+	int peek() { return at_end() ? EOF : static_cast<unsigned char>(*cur); }
+
+	// Skip whitespace, counting lines and characters skipped.
+	void skip_space(int &line, int &pos) {
+		if (index) {
+			const char *start = cur;
+			cur = next < index->ntokens ? begin + index->token_offset(next) : end;
+			line += count_newlines(start, cur);
+			pos += cur - start;
+			return;
+		}
+		do {
+			const char *start = cur;
+			cur = ::skip_space(cur, end);
+			line += count_newlines(start, cur);
+			pos += cur - start;
+		} while (cur == end && refill());
+	}
+
+	// Read a token, assuming that whitespace has been skipped.
+	std::string_view token() {
+		if (index) {
+			const char *start = begin + index->token_offset(next);
+			cur = start + index->token_length(next++);
+			return std::string_view(start, cur - start);
+		}
+		size_t start = base + (cur - begin);
+		cur = skip_token(cur, end);
+		while (cur == end && refill(start)) cur = skip_token(cur, end);
+		return std::string_view(begin + (start - base), cur - (begin + (start - base)));
+	}
+
+	// Parse the token just read as float.
+	bool token_float(std::string_view token, flt &val) const {
+		if (index) return index->token_float(next-1, token, val);
+		return isfloat(token, val);
+	}
+};
+
+template <typename Stream>
+void openfile(Stream &stream, const char *file, const char *whoami) {
+	stream.open(file);
+	if (stream.fail()) {
+		judge_error("%s: failed to open %s\n", whoami, file);
+	}
+}
+
+FILE *openfeedback(const char *feedbackdir, const char *feedback, const char *whoami) {
+	std::string path = std::string(feedbackdir) + "/" + std::string(feedback);
+	FILE *res = fopen(path.c_str(), "w");
+	if (!res) {
+		judge_error("%s: failed to open %s for writing", whoami, path.c_str());
+	}
+	return res;
+}
+
+// The behavior of std::tolower on (signed) char is undefined.
+char tolower_char(char c)
+{
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+bool equal_case_insensitive(std::string_view a, std::string_view b)
+{
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i] != b[i] && tolower_char(a[i]) != tolower_char(b[i])) return false;
+	}
+	return true;
+}
+
+// Note to add to a wrong answer message if a token is not printable.
+std::string nonprintable_note(std::string_view judge, std::string_view team)
+{
+	std::string msg = "";
+	bool nonprintable = false;
+	for (char c : judge) {
+		if (!std::isprint(static_cast<unsigned char>(c))) {
+			nonprintable = true;
+			msg += "judge";
+			break;
+		}
+	}
+	for (char c : team) {
+		if (!std::isprint(static_cast<unsigned char>(c))) {
+			if (nonprintable) msg += ',';
+			nonprintable = true;
+			msg += "team";
+			break;
+		}
+	}
+	if (nonprintable) {
+		msg = "\nNote: " + msg + " token contains non-printable characters";
+	}
+	return msg;
+}
+
+/* Test two floating-point numbers for equality, accounting for +/-INF, NaN, and precision.
+ * Float `jval` is considered the reference value for relative error.
+ */
+void compare_float(std::string_view judge, std::string_view team, flt jval, flt tval, flt float_abs_tol, flt float_rel_tol) {
+	/* Finite values are compared with some tolerance */
+	if (std::isfinite(tval) && std::isfinite(jval)) {
+		flt absdiff = fabsl(tval-jval);
+		flt reldiff = fabsl((tval-jval)/jval);
+		if (float_abs_tol >= 0 && float_rel_tol >= 0) {
+			if (absdiff > float_abs_tol && reldiff > float_rel_tol) {
+				wrong_answer("Too large difference.\n Judge: %s\n Team: %s\n Absolute difference: %Lg (tolerance: %Lg)\n Relative difference: %Lg (tolerance: %Lg)%s",
+				             str(judge).c_str(), str(team).c_str(),
+				             absdiff, float_abs_tol,
+				             reldiff, float_rel_tol,
+				             nonprintable_note(judge, team).c_str());
+			}
+		} else if (float_abs_tol >= 0) {
+			if (absdiff > float_abs_tol) {
+				wrong_answer("Too large difference.\n Judge: %s\n Team: %s\n Absolute difference: %Lg (tolerance: %Lg)%s",
+				             str(judge).c_str(), str(team).c_str(), absdiff, float_abs_tol, nonprintable_note(judge, team).c_str());
+			}
+		} else if (float_rel_tol >= 0) {
+			if (reldiff > float_rel_tol) {
+				wrong_answer("Too large difference.\n Judge: %s\n Team: %s\n Relative difference: %Lg (tolerance: %Lg)%s",
+				             str(judge).c_str(), str(team).c_str(), reldiff, float_rel_tol, nonprintable_note(judge, team).c_str());
+			}
+		}
+	/* NaN is equal to NaN */
+	} else if (std::isnan(jval) && std::isnan(tval)) {
+		return;
+	/* Infinite values are equal if their sign matches */
+	} else if (std::isinf(jval) && std::isinf(tval)) {
+		if (std::signbit(jval) != std::signbit(tval)) {
+			wrong_answer("Expected float %s, got: %s%s", str(judge).c_str(), str(team).c_str(), nonprintable_note(judge, team).c_str());
+		}
+	/* Values in different classes are always different. */
+	} else {
+		wrong_answer("Expected float %s, got: %s%s", str(judge).c_str(), str(team).c_str(), nonprintable_note(judge, team).c_str());
+	}
+}
+
+/* Same test as compare_float(), without reporting. */
+bool floats_match(flt jval, flt tval, flt float_abs_tol, flt float_rel_tol) {
+	if (std::isfinite(tval) && std::isfinite(jval)) {
+		flt absdiff = fabsl(tval-jval);
+		flt reldiff = fabsl((tval-jval)/jval);
+		if (float_abs_tol >= 0 && float_rel_tol >= 0) {
+			return !(absdiff > float_abs_tol && reldiff > float_rel_tol);
+		} else if (float_abs_tol >= 0) {
+			return !(absdiff > float_abs_tol);
+		} else if (float_rel_tol >= 0) {
+			return !(reldiff > float_rel_tol);
+		}
+		return true;
+	} else if (std::isnan(jval) && std::isnan(tval)) {
+		return true;
+	} else if (std::isinf(jval) && std::isinf(tval)) {
+		return std::signbit(jval) == std::signbit(tval);
+	}
+	return false;
+}
+
+/* Parallel comparison of large outputs, when whitespace changes are
+ * ignored. Both inputs are split at whitespace into chunks, and the
+ * tokens and newlines in each chunk are counted in parallel. Then each
+ * chunk of the judge answer is compared against the team output starting
+ * at the same token index, again in parallel. This only determines the
+ * first chunk that does not match: the sequential comparison is then
+ * restarted from there, so that the reported error is exactly the first
+ * one, with the correct line numbers and positions.
+ */
+const size_t PARALLEL_MIN_SIZE = 16 << 20;
+const int PARALLEL_MAX_THREADS = 8;
+
+int compare_threads() {
+	cpu_set_t cpus;
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) return 1;
+	return std::min(CPU_COUNT(&cpus), PARALLEL_MAX_THREADS);
+}
+
+// Run job(0..njobs-1) on up to nthreads threads.
+template <typename Job>
+void run_parallel(int nthreads, size_t njobs, Job job) {
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i; (i = next++) < njobs; ) job(i);
+	};
+	std::vector<std::thread> threads;
+	for (int i = 1; i < nthreads; i++) {
+		try {
+			threads.emplace_back(worker);
+		} catch (const std::system_error &) {
+			break; // Continue with the threads we have.
+		}
+	}
+	worker();
+	for (auto &t : threads) t.join();
+}
+
+struct chunk_info {
+	const char *begin, *end;
+	size_t tokens = 0, newlines = 0;
+	// Number of tokens and newlines before this chunk.
+	size_t first_token = 0, first_line = 0;
+
+	void count() {
+		newlines = count_newlines(begin, end);
+		for (const char *p = skip_space(begin, end); p < end; p = skip_space(p, end)) {
+			tokens++;
+			p = skip_token(p, end);
+		}
+	}
+};
+
+// Split [begin,end) into about n chunks, ending in whitespace or at end.
+std::vector<chunk_info> split_chunks(const char *begin, const char *end, int n) {
+	std::vector<chunk_info> chunks;
+	size_t size = (end - begin) / n + 1;
+	for (const char *p = begin; p < end; ) {
+		const char *q = (size_t)(end - p) > size ? skip_token(p + size, end) : end;
+		chunks.push_back({p, q});
+		p = q;
+	}
+	return chunks;
+}
+
+void count_chunks(std::vector<chunk_info> &chunks, int nthreads) {
+	run_parallel(nthreads, chunks.size(), [&](size_t i) { chunks[i].count(); });
+	for (size_t i = 1; i < chunks.size(); i++) {
+		chunks[i].first_token = chunks[i-1].first_token + chunks[i-1].tokens;
+		chunks[i].first_line = chunks[i-1].first_line + chunks[i-1].newlines;
+	}
+}
+
+/* Find the first chunk of the judge answer in [judgeans.cur,judgeans.end)
+ * that does not match the team output according to match(), and move both
+ * tokenizers to the start of that chunk. Returns false if all of the
+ * output matches. The line counters are set to the lines at the new
+ * positions, the character counters are left to the caller.
+ */
+template <typename Match>
+bool parallel_compare(tokenizer &judgeans, tokenizer &team_out, int nthreads, Match match) {
+	const int chunks_per_thread = 4;
+	std::vector<chunk_info> jchunks = split_chunks(judgeans.cur, judgeans.end, nthreads*chunks_per_thread);
+	std::vector<chunk_info> tchunks = split_chunks(team_out.cur, team_out.end, nthreads*chunks_per_thread);
+	count_chunks(jchunks, nthreads);
+	count_chunks(tchunks, nthreads);
+	if (jchunks.empty() || tchunks.empty()) return true;
+
+	// Team output position (and its line) of the first token of each chunk.
+	std::vector<const char *> tstart(jchunks.size());
+	std::vector<size_t> tline(jchunks.size());
+	std::atomic<size_t> first_bad(jchunks.size());
+	run_parallel(nthreads, jchunks.size(), [&](size_t i) {
+		const chunk_info &jc = jchunks[i];
+		size_t t = std::upper_bound(tchunks.begin(), tchunks.end(), jc.first_token,
+		                            [](size_t tok, const chunk_info &c) { return tok < c.first_token; })
+		           - tchunks.begin() - 1;
+		const char *p = tchunks[t].begin;
+		for (size_t skip = jc.first_token - tchunks[t].first_token; skip > 0; skip--) {
+			p = skip_token(skip_space(p, team_out.end), team_out.end);
+		}
+		tstart[i] = p;
+		tline[i] = tchunks[t].first_line + count_newlines(tchunks[t].begin, p);
+
+		for (const char *q = jc.begin; ; ) {
+			if (first_bad < i) return;
+			q = skip_space(q, jc.end);
+			p = skip_space(p, team_out.end);
+			if (q == jc.end) break;
+			const char *jtok = q, *ttok = p;
+			q = skip_token(q, jc.end);
+			p = skip_token(p, team_out.end);
+			if (p == ttok || !match(std::string_view(jtok, q - jtok),
+			                        std::string_view(ttok, p - ttok))) {
+				// Lower the first bad chunk to i, unless already lower.
+				size_t bad = first_bad;
+				while (i < bad && !first_bad.compare_exchange_weak(bad, i)) {}
+				return;
+			}
+		}
+	});
+
+	size_t bad = first_bad;
+	if (bad == jchunks.size()) {
+		// All judge tokens match: only check for trailing team output.
+		if (tchunks.back().first_token + tchunks.back().tokens == jchunks.back().first_token + jchunks.back().tokens) {
+			return false;
+		}
+		bad = jchunks.size() - 1;
+	}
+	judgeans.seek(jchunks[bad].begin);
+	team_out.cur = tstart[bad];
+	judgeans_line += jchunks[bad].first_line;
+	stdin_line += tline[bad];
+	return true;
+}
+
+/* Compare the whitespace runs at the current positions, which must be
+ * identical for space_change_sensitive, and move past them.
+ */
+void compare_space(tokenizer &judgeans, tokenizer &team_out) {
+	// The team output must extend past the judge whitespace, if it can.
+	if (team_out.source && team_out.end - team_out.cur <= judgeans.end - judgeans.cur) {
+		team_out.ensure(skip_space(judgeans.cur, judgeans.end) - judgeans.cur + 1);
+	}
+
+	const char *judge = judgeans.cur, *team = team_out.cur;
+	size_t judge_avail = judgeans.end - judge, team_avail = team_out.end - team;
+
+	// Most runs are short, compare those directly and longer ones in blocks.
+	const size_t short_run = 16;
+	size_t same = 0;
+	int lines = 0;
+	while (same < short_run && same < judge_avail && same < team_avail &&
+	       is_space(judge[same]) && judge[same] == team[same]) {
+		lines += judge[same] == '\n';
+		same++;
+	}
+	if (same == short_run) {
+		size_t judge_len = skip_space(judge + same, judgeans.end) - judge;
+		size_t team_len = skip_space(team + same, team_out.end) - team;
+		same += common_prefix(judge + same, team + same, std::min(judge_len, team_len) - same);
+		lines += count_newlines(judge + short_run, judge + same);
+	}
+
+	judgeans_line += lines;
+	stdin_line += lines;
+	judgeans_pos += same;
+	stdin_pos += same;
+	judgeans.cur += same;
+	team_out.cur += same;
+
+	if (same < judge_avail && is_space(judge[same])) {
+		wrong_answer("Space change error: got %d expected %d", team_out.peek(), judge[same]);
+	}
+	if (same < team_avail && is_space(team[same])) {
+		wrong_answer("Space change error: judge out of space, got %d from team", team[same]);
+	}
+}
+
+struct compare_options {
+	bool case_sensitive = false;
+	bool space_change_sensitive = false;
+	flt float_abs_tol = -1;
+	flt float_rel_tol = -1;
+};
+
+/* Compare the team output with the judge answer, read from judgeans_file,
+ * and exit with EXIT_AC or EXIT_WA. The reason for a wrong answer is
+ * written to the feedback files, which must have been opened already.
+ */
+[[noreturn]] void compare_output(input_buffer &judgeans_buf, input_buffer &stdin_buf,
+                                 const char *judgeans_file, const compare_options &opts) {
+	const bool case_sensitive = opts.case_sensitive;
+	const bool space_change_sensitive = opts.space_change_sensitive;
+	const flt float_abs_tol = opts.float_abs_tol;
+	const flt float_rel_tol = opts.float_rel_tol;
+	const bool use_floats = float_abs_tol >= 0 || float_rel_tol >= 0;
+
+	// Most accepted outputs are identical to the answer, and identical
+	// tokens are accepted with any options. So accept identical outputs
+	// right away, and otherwise start comparing tokens from the last token
+	// boundary before the first difference: both sides have been consumed
+	// identically up to there. A team output stream is compared as it
+	// arrives, and dropped up to the last token boundary compared.
+	size_t same = 0;
+	do {
+		size_t team_end = stdin_buf.offset + stdin_buf.size;
+		same += common_prefix(judgeans_buf.data + same, stdin_buf.data + (same - stdin_buf.offset),
+		                      std::min(judgeans_buf.size, team_end) - same);
+		if (same < team_end) break;
+		size_t keep = same;
+		while (keep > stdin_buf.offset && !is_space(judgeans_buf.data[keep-1])) --keep;
+		stdin_buf.discard(keep);
+	} while (stdin_buf.read_more());
+	if (same == judgeans_buf.size && same == stdin_buf.offset + stdin_buf.size) {
+		exit(EXIT_AC);
+	}
+
+	tokenizer judgeans(judgeans_buf), team_out(stdin_buf);
+
+	answer_index index;
+	std::string index_image;
+	if (!space_change_sensitive &&
+	    setup_index(index, index_image, judgeans_buf, judgeans_file)) {
+		judgeans.index = &index;
+	}
+
+	while (same > 0 && !is_space(judgeans_buf.data[same-1])) --same;
+	judgeans.seek(judgeans.cur + same);
+	team_out.cur += same - stdin_buf.offset;
+	judgeans_line = stdin_line = 1 + count_newlines(judgeans_buf.data, judgeans.cur);
+	judgeans_pos = stdin_pos = same;
+
+	int nthreads;
+	if (!space_change_sensitive && stdin_buf.complete() &&
+	    (size_t)(judgeans.end - judgeans.cur) >= PARALLEL_MIN_SIZE &&
+	    (nthreads = compare_threads()) > 1) {
+		auto match = [&](std::string_view judge, std::string_view team) {
+			flt jval, tval;
+			if (use_floats && isfloat(judge, jval)) {
+				return isfloat(team, tval) && floats_match(jval, tval, float_abs_tol, float_rel_tol);
+			} else if (case_sensitive) {
+				return judge == team;
+			}
+			return equal_case_insensitive(judge, team);
+		};
+		const char *judge_start = judgeans.cur, *team_start = team_out.cur;
+		if (!parallel_compare(judgeans, team_out, nthreads, match)) {
+			exit(EXIT_AC);
+		}
+		judgeans_pos += judgeans.cur - judge_start;
+		stdin_pos += team_out.cur - team_start;
+	}
+
+	std::string_view judge, team;
+	while (true) {
+		// Space!  Can't live with it, can't live without it...
+		if (space_change_sensitive) {
+			compare_space(judgeans, team_out);
+		} else {
+			judgeans.skip_space(judgeans_line, judgeans_pos);
+			team_out.skip_space(stdin_line, stdin_pos);
+		}
+
+		if (judgeans.at_end())
+			break;
+		judge = judgeans.token();
+
+		if (team_out.at_end()) {
+			wrong_answer("User EOF while judge had more output\n(Next judge token: %s)", str(judge).c_str());
+		}
+		team = team_out.token();
+
+		flt jval, tval;
+		if (use_floats && judgeans.token_float(judge, jval)) {
+			if (!isfloat(team, tval)) {
+				wrong_answer("Expected float, got: %s%s", str(team).c_str(), nonprintable_note(judge, team).c_str());
+			}
+			compare_float(judge, team, jval, tval, float_abs_tol, float_rel_tol);
+		} else if (case_sensitive) {
+			if (judge != team) {
+				wrong_answer("String tokens mismatch\nJudge: \"%s\"\nTeam: \"%s\"%s",
+				             str(judge).c_str(), str(team).c_str(), nonprintable_note(judge, team).c_str());
+			}
+		} else {
+			if (!equal_case_insensitive(judge, team)) {
+				wrong_answer("String tokens mismatch\nJudge: \"%s\"\nTeam: \"%s\"%s",
+				             str(judge).c_str(), str(team).c_str(), nonprintable_note(judge, team).c_str());
+			}
+		}
+		judgeans_pos += judge.length();
+		stdin_pos += team.length();
+	}
+
+	if (!team_out.at_end()) {
+		wrong_answer("Trailing output:\n%s", str(team_out.token()).c_str());
+	}
+
+	exit(EXIT_AC);
+}
+
+#endif /* COMPARE_H */